@@ -3,70 +3,483 @@
 #pragma once
 
 #include "basis.hpp"
+#include "functions.hpp"
+#include "ref.hpp"
 #include "user_data.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 
 namespace lua_bender{
+    struct lua_any_table;
+
+    /**
+     * @brief Bump allocator backing the tables captured by lua_any_t::get_results, released at once.
+     * It also records the registry references taken on the captured functions and threads (see release_handles).
+     */
+    struct lua_any_arena{
+        struct block{
+            block*      m_next;
+            std::size_t m_size;
+        };
+
+        static constexpr std::size_t s_default_block_size = 16384;
+
+        block*           m_blocks;
+        char*            m_current;
+        std::size_t      m_left;
+        std::size_t      m_block_size;
+        std::vector<int> m_handles;
+
+        lua_any_arena(std::size_t block_size = s_default_block_size): m_blocks(), m_current(), m_left(), m_block_size(block_size), m_handles(){}
+        lua_any_arena(const lua_any_arena&) = delete;
+        lua_any_arena& operator=(const lua_any_arena&) = delete;
+        ~lua_any_arena(){ clear(); }
+
+        void* allocate(std::size_t size, std::size_t alignment){
+            std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(m_current) % alignment) % alignment;
+            if( m_current == nullptr || padding + size > m_left ){
+                std::size_t block_size = size + alignment > m_block_size ? size + alignment : m_block_size;
+                block* head = static_cast<block*>(::operator new(sizeof(block) + block_size));
+                head->m_next = m_blocks;
+                head->m_size = block_size;
+                m_blocks = head;
+                m_current = reinterpret_cast<char*>(head + 1);
+                m_left = block_size;
+                padding = (alignment - reinterpret_cast<std::uintptr_t>(m_current) % alignment) % alignment;
+            }
+            char* res = m_current + padding;
+            m_current = res + size;
+            m_left -= padding + size;
+            return res;
+        }
+
+        /** @brief Allocate count default constructed T, never destroyed: T must not own any other resource. */
+        template<typename T>
+        T* allocate_array(std::size_t count){
+            T* res = static_cast<T*>(allocate(sizeof(T) * (count > 0 ? count : 1), alignof(T)));
+            for(std::size_t i = 0; i < count; ++i){
+                new (res + i) T();
+            }
+            return res;
+        }
+
+        char* copy_string(const char* str, std::size_t size){
+            char* res = static_cast<char*>(allocate(size + 1, 1));
+            std::memcpy(res, str, size);
+            res[size] = '\0';
+            return res;
+        }
+
+        /** @brief Release all the memory at once, the captured values must not be used anymore. */
+        void clear(){
+            while( m_blocks != nullptr ){
+                block* next = m_blocks->m_next;
+                ::operator delete(m_blocks);
+                m_blocks = next;
+            }
+            m_current = nullptr;
+            m_left = 0;
+            m_handles.clear();
+        }
+
+        /** @brief Unreference the captured functions and threads, needed only if the state outlives the arena. */
+        void release_handles(lua_State* L){
+            for(int handle : m_handles){
+                luaL_unref(L, LUA_REGISTRYINDEX, handle);
+            }
+            m_handles.clear();
+        }
+    };
+
+
+    // lua_any_t is a tagged union: only the member matching m_lua_type is valid.
+    // Strings up to s_small_capacity characters are stored inline, longer ones in a single heap block,
+    // which keeps the whole structure at 24 bytes on 64 bits platforms.
     struct lua_any_t{
-        lua_Number    m_number;
-        std::string   m_str;
-        void*         m_udata;
-        lua_CFunction m_func;
-        int           m_lua_type;
+        static constexpr std::size_t s_small_capacity = 15;
+        // Values of m_small_size when the string is stored on the heap, or in a lua_any_arena,
+        // and when the value is a registry reference owned by this lua_any_t (see get_references).
+        static constexpr std::uint8_t s_heap_string  = 0xFF;
+        static constexpr std::uint8_t s_arena_string = 0xFE;
+        static constexpr std::uint8_t s_owned_handle = 0xFD;
+        // Value of m_small_size when a number is an integer kept in m_integer, exact beyond the 53 bits of a double.
+        static constexpr std::uint8_t s_integer      = 0xFC;
+        // Nesting limit of the captured tables, deeper ones being read as nil.
+        static constexpr int s_max_depth = 200;
+
+        union{
+            lua_Number    m_number;
+            lua_Integer   m_integer;
+            void*         m_udata;
+            lua_CFunction m_func;
+            struct{
+                char*       m_data;
+                std::size_t m_size;
+            }             m_heap;
+            char          m_small[s_small_capacity + 1];
+            // Tables captured in a lua_any_arena.
+            lua_any_table* m_table;
+            // Registry reference of a captured value, the state being only set when this lua_any_t owns it.
+            struct{
+                lua_State*  m_state;
+                int         m_ref;
+            }             m_handle;
+        };
+        std::int8_t   m_lua_type;
+        std::uint8_t  m_small_size;
+
+        lua_any_t(): m_number(), m_lua_type(LUA_TNIL), m_small_size(){}
+
+        lua_any_t(const lua_any_t& other): m_number(), m_lua_type(LUA_TNIL), m_small_size(){
+            *this = other;
+        }
+
+        lua_any_t(lua_any_t&& other) noexcept: m_number(), m_lua_type(LUA_TNIL), m_small_size(){
+            *this = std::move(other);
+        }
+
+        ~lua_any_t(){ reset(); }
+
+        lua_any_t& operator=(const lua_any_t& other){
+            if( this != &other ){
+                if( other.m_lua_type == LUA_TSTRING ){
+                    set_string(other.c_str(), other.string_size());
+                }
+                else if( other.m_small_size == s_owned_handle ){
+                    other.push_handle(other.m_handle.m_state);
+                    set_reference(other.m_handle.m_state, -1);
+                    lua_pop(other.m_handle.m_state, 1);
+                }
+                else{
+                    reset();
+                    std::memcpy(static_cast<void*>(this), static_cast<const void*>(&other), sizeof(lua_any_t));
+                }
+            }
+            return *this;
+        }
+
+        /** @brief Moving only copies the bytes, a heap string changing of owner and a table staying in its arena. */
+        lua_any_t& operator=(lua_any_t&& other) noexcept{
+            if( this != &other ){
+                reset();
+                std::memcpy(static_cast<void*>(this), static_cast<const void*>(&other), sizeof(lua_any_t));
+                other.m_lua_type = LUA_TNIL;
+                other.m_small_size = 0;
+            }
+            return *this;
+        }
 
-        lua_any_t(): m_number(), m_str(), m_udata(), m_lua_type(){}
+        /** @brief Release the string or the owned reference if any and become nil. */
+        void reset(){
+            if( m_lua_type == LUA_TSTRING && m_small_size == s_heap_string ){
+                delete[] m_heap.m_data;
+            }
+            else if( m_small_size == s_owned_handle ){
+                lua_ref_cache::release(m_handle.m_state, m_handle.m_ref);
+            }
+            m_number = lua_Number();
+            m_lua_type = LUA_TNIL;
+            m_small_size = 0;
+        }
+
+        void set_number(lua_Number number){
+            reset();
+            m_number = number;
+            m_lua_type = LUA_TNUMBER;
+        }
+
+        void set_integer(lua_Integer integer){
+            reset();
+            m_integer = integer;
+            m_lua_type = LUA_TNUMBER;
+            m_small_size = s_integer;
+        }
+
+        bool is_integer() const{ return m_lua_type == LUA_TNUMBER && m_small_size == s_integer; }
+
+        void set_string(const char* str, std::size_t size){
+            // The source may be this very string, so the new value is built before the current one is released.
+            lua_any_t res;
+            if( size > s_small_capacity ){
+                res.m_heap.m_data = new char[size + 1];
+                res.m_heap.m_size = size;
+                res.m_small_size = s_heap_string;
+                std::memcpy(res.m_heap.m_data, str, size);
+                res.m_heap.m_data[size] = '\0';
+            }
+            else{
+                res.m_small_size = std::uint8_t(size);
+                std::memcpy(res.m_small, str, size);
+                res.m_small[size] = '\0';
+            }
+            res.m_lua_type = LUA_TSTRING;
+            *this = std::move(res);
+        }
+
+        /** @brief Reference a string allocated in an arena, which is not released with the value. */
+        void set_arena_string(const char* str, std::size_t size){
+            reset();
+            m_heap.m_data = const_cast<char*>(str);
+            m_heap.m_size = size;
+            m_small_size = s_arena_string;
+            m_lua_type = LUA_TSTRING;
+        }
+
+        bool is_small_string() const{ return m_small_size != s_heap_string && m_small_size != s_arena_string; }
+
+        /** @brief Keep the value at the given index as a registry reference owned by this lua_any_t. */
+        void set_reference(lua_State* L, int index){
+            int type = lua_type(L, index);
+            lua_ref ref(L, index);
+            reset();
+            m_handle.m_state = ref.m_state;
+            m_handle.m_ref = ref.m_ref;
+            m_small_size = s_owned_handle;
+            m_lua_type = std::int8_t(type);
+            // The ownership now belongs to this value.
+            ref.m_state = nullptr;
+        }
+
+        /** @brief Move the owned reference out of this value, which becomes nil. */
+        lua_ref take_reference(){
+            lua_ref res;
+            if( m_small_size == s_owned_handle ){
+                res.m_state = m_handle.m_state;
+                res.m_ref = m_handle.m_ref;
+                m_small_size = 0;
+            }
+            reset();
+            return res;
+        }
+
+        std::size_t string_size() const{ return is_small_string() ? m_small_size : m_heap.m_size; }
+
+        /** @brief Null terminated string, empty if the value is not a string. */
+        const char* c_str() const{
+            if( m_lua_type != LUA_TSTRING ){
+                return "";
+            }
+            return is_small_string() ? m_small : m_heap.m_data;
+        }
+
+        std::string_view str() const{ return std::string_view(c_str(), m_lua_type == LUA_TSTRING ? string_size() : 0); }
+
+        /**
+         * @brief Return the value converted to T, which can be bool, an arithmetic or enumeration type, std::string,
+         * std::string_view, const char*, const lua_any_table* or a user data pointer.
+         * Pointers are null when the value has another type, the other types log an error and return T().
+         */
+        template<typename T>
+        T get() const{
+            if constexpr( std::is_same<T, bool>::value ){
+                // Lua truth: everything but nil and false.
+                return m_lua_type == LUA_TBOOLEAN ? m_number != 0 : m_lua_type != LUA_TNIL && m_lua_type != LUA_TNONE;
+            }
+            else if constexpr( std::is_arithmetic<T>::value || std::is_enum<T>::value ){
+                if( m_lua_type == LUA_TNUMBER ){
+                    return is_integer() ? static_cast<T>(m_integer) : static_cast<T>(m_number);
+                }
+            }
+            else if constexpr( std::is_same<T, std::string>::value || std::is_same<T, std::string_view>::value ){
+                if( m_lua_type == LUA_TSTRING ){
+                    return T(c_str(), string_size());
+                }
+            }
+            else if constexpr( std::is_same<T, const char*>::value ){
+                if( m_lua_type == LUA_TSTRING ){
+                    return c_str();
+                }
+            }
+            else if constexpr( std::is_same<T, const lua_any_table*>::value ){
+                return m_lua_type == LUA_TTABLE ? m_table : nullptr;
+            }
+            else{
+                static_assert(std::is_pointer<T>::value, "lua_bender::lua_any_t::get unsupported type");
+                return m_lua_type == LUA_TUSERDATA || m_lua_type == LUA_TLIGHTUSERDATA ? static_cast<T>(m_udata) : nullptr;
+            }
+
+            LUA_BENDER_LOG_ERROR("lua_bender::lua_any_t::get the value has another type (lua type %d)", int(m_lua_type));
+            return T();
+        }
+
+        /**
+         * @brief Convert the sizeof...(Ts) topmost values of the stack, from bottom to top, with the value templates.
+         * Unlike the lua_any_t vectors, user data read as pointers stay owned by Lua, read them as std::unique_ptr to take them over.
+         *
+         * auto [object, count, name] = lua_any_t::get_results<test_struct*, int, std::string>(L);
+         */
+        template<typename ...Ts>
+        static std::tuple<Ts...> get_results(lua_State* L){
+            int first = lua_gettop(L) - int(sizeof...(Ts)) + 1;
+            if( first < 1 ){
+                LUA_BENDER_LOG_ERROR("lua_bender::lua_any_t::get_results expects %d values, the stack holds %d", int(sizeof...(Ts)), lua_gettop(L));
+                return std::tuple<Ts...>();
+            }
+            return read_results<Ts...>(L, first, std::index_sequence_for<Ts...>());
+        }
+
+        template<typename ...Ts, std::size_t ...Is>
+        static std::tuple<Ts...> read_results(lua_State* L, int first, std::index_sequence<Is...>){
+            // The braced initialization reads the values in order.
+            return std::tuple<Ts...>{ value< typename add_const_ref<Ts>::type >::check(L, first + int(Is))... };
+        }
 
         static void get_results(lua_State* L, std::vector<lua_any_t>& res){
             int returned_value_count = lua_gettop(L);
-            user_data* udata;
 
             res.clear();
             res.resize(returned_value_count);
             // Reading the Lua stack from bottom to top.
             for(int i = 0; i < returned_value_count; ++i){
-                int type = lua_type(L, i+1);
-                res[i].m_lua_type = type;
-                switch( type ){
-                    case LUA_TNIL:
+                res[i].read(L, i+1, nullptr, 0);
+            }
+        }
+
+        /**
+         * @brief Read all the values of the stack, capturing the tables recursively in the arena and the functions and threads
+         * as registry references. Tables reached several times, cycles included, are captured once and shared.
+         */
+        static void get_results(lua_State* L, std::vector<lua_any_t>& res, lua_any_arena& arena){
+            int returned_value_count = lua_gettop(L);
+
+            res.clear();
+            res.resize(returned_value_count);
+            // The captured tables are indexed by their Lua table in a temporary table.
+            lua_newtable(L);
+            int visited = lua_gettop(L);
+            for(int i = 0; i < returned_value_count; ++i){
+                res[i].read(L, i+1, &arena, visited);
+            }
+            lua_pop(L, 1);
+        }
+
+        /**
+         * @brief Read the value at the given index, tables, functions and threads being only supported with an arena:
+         * without one they are reported and read as nil, as the tables nested deeper than s_max_depth.
+         */
+        void read(lua_State* L, int index, lua_any_arena* arena, int visited, int depth = 0){
+            user_data* udata;
+            const char* str;
+            size_t length;
+
+            int type = lua_type(L, index);
+            reset();
+            m_lua_type = std::int8_t(type);
+            switch( type ){
+                case LUA_TNIL:
+                    if( arena == nullptr ){
                         LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is acessing an unexpected nil value");
+                    }
+                    break;
+                case LUA_TNONE:
+                    LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is acessing an unexpected no type value");
+                    break;
+                case LUA_TNUMBER:
+                    if( lua_isinteger(L, index) ){
+                        m_integer = lua_tointeger(L, index);
+                        m_small_size = s_integer;
+                    }
+                    else{
+                        m_number = lua_tonumber(L, index);
+                    }
+                    break;
+                case LUA_TTABLE:
+                    if( arena == nullptr ){
+                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing a table, which requires a lua_any_arena.");
+                        m_lua_type = LUA_TNIL;
                         break;
-                    case LUA_TNONE:
-                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is acessing an unexpected no type value");
-                        break;
-                    case LUA_TNUMBER:
-                        res[i].m_number = luaL_checknumber(L, i+1);
-                        break;
-                    case LUA_TTABLE:
-                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing a table which is not supported for now.");
-                        break;
-                    case LUA_TSTRING:
-                        res[i].m_str = luaL_checkstring(L, i+1);
+                    }
+                    if( depth >= s_max_depth ){
+                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing tables nested deeper than %d levels.", s_max_depth);
+                        m_lua_type = LUA_TNIL;
                         break;
-                    case LUA_TUSERDATA:
-                        udata = *(user_data**)lua_touserdata(L, i+1);
-                        if( udata != nullptr ){
-                            // If a user data is returned AND recovered from a script, the ownership is transfered to the data consummer.
-                            udata->m_garbage_collected = false;
-                            res[i].m_udata = udata->m_data;
+                    }
+                    m_table = capture_table(L, index, *arena, visited, depth);
+                    break;
+                case LUA_TSTRING:
+                    str = lua_tolstring(L, index, &length);
+                    if( arena != nullptr && length > s_small_capacity ){
+                        set_arena_string(arena->copy_string(str, length), length);
+                    }
+                    else{
+                        set_string(str, length);
+                    }
+                    break;
+                case LUA_TUSERDATA:
+                    udata = *(user_data**)lua_touserdata(L, index);
+                    if( udata != nullptr ){
+                        if( udata->m_release != nullptr ){
+                            LUA_BENDER_LOG_WARNING("lua_bender::script::get_results is accessing a user data owned by a smart pointer, it stays valid only as long as the state.");
                         }
-                        break;
-                    case LUA_TLIGHTUSERDATA:
+                        // If a user data is returned AND recovered from a script, the ownership is transfered to the data consummer.
+                        udata->m_garbage_collected = false;
+                        m_udata = udata->m_data;
+                    }
+                    break;
+                case LUA_TLIGHTUSERDATA:
+                    if( arena == nullptr ){
                         LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing a light user data which is not supported.");
+                    }
+                    m_udata = lua_touserdata(L, index);
+                    break;
+                case LUA_TBOOLEAN:
+                    m_number = lua_toboolean(L, index);
+                    break;
+                case LUA_TTHREAD:
+                case LUA_TFUNCTION:
+                    if( arena == nullptr ){
+                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing a %s, which requires a lua_any_arena.", lua_typename(L, type));
+                        // Without a registry reference it could not be pushed back.
+                        m_lua_type = LUA_TNIL;
                         break;
+                    }
+                    lua_pushvalue(L, index);
+                    m_handle.m_state = nullptr;
+                    m_handle.m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+                    arena->m_handles.push_back(m_handle.m_ref);
+                    break;
+            }
+        }
+
+        static lua_any_table* capture_table(lua_State* L, int index, lua_any_arena& arena, int visited, int depth);
+
+        /**
+         * @brief Read all the values of the stack, the tables, functions, threads and user data being kept as registry references
+         * instead of being copied, to be decoded later only if needed with push_handle. The user data stay owned by Lua.
+         * The references are released with the values, which must happen before the state is closed.
+         */
+        static void get_references(lua_State* L, std::vector<lua_any_t>& res){
+            int returned_value_count = lua_gettop(L);
+
+            res.clear();
+            res.resize(returned_value_count);
+            for(int i = 0; i < returned_value_count; ++i){
+                switch( lua_type(L, i+1) ){
+                    case LUA_TTABLE:
+                    case LUA_TFUNCTION:
                     case LUA_TTHREAD:
-                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing a thread which is not supported for now.");
-                        break;
-                    case LUA_TBOOLEAN:
-                        res[i].m_number = lua_toboolean(L, i+1);
+                    case LUA_TUSERDATA:
+                        res[i].set_reference(L, i+1);
                         break;
-                    case LUA_TFUNCTION:
-                        LUA_BENDER_LOG_ERROR("lua_bender::script::get_results is accessing a function which is not supported for now.");
+                    default:
+                        res[i].read(L, i+1, nullptr, 0);
                         break;
                 }
             }
         }
 
+        /** @brief Push back a value kept as a registry reference, captured function or thread included. */
+        int push_handle(lua_State* L) const{
+            return lua_rawgeti(L, LUA_REGISTRYINDEX, m_handle.m_ref);
+        }
+
 
         void log_type_name() const{
             switch( m_lua_type ){
@@ -77,13 +490,18 @@ namespace lua_bender{
                     LUA_BENDER_LOG_INFO("any is type NONE");
                     break;
                 case LUA_TNUMBER:
-                    LUA_BENDER_LOG_INFO("any is type NUMBER: %f", m_number);
+                    if( is_integer() ){
+                        LUA_BENDER_LOG_INFO("any is type INTEGER: %lld", static_cast<long long>(m_integer));
+                    }
+                    else{
+                        LUA_BENDER_LOG_INFO("any is type NUMBER: %f", m_number);
+                    }
                     break;
                 case LUA_TTABLE:
                     LUA_BENDER_LOG_INFO("any is type TABLE");
                     break;
                 case LUA_TSTRING:
-                    LUA_BENDER_LOG_INFO("any is type STRING: \"%s\"", m_str.c_str());
+                    LUA_BENDER_LOG_INFO("any is type STRING: \"%s\"", c_str());
                     break;
                 case LUA_TUSERDATA:
                     LUA_BENDER_LOG_INFO("any is type USER DATA");
@@ -105,6 +523,102 @@ namespace lua_bender{
     };
 
 
+    struct lua_any_entry{
+        lua_any_t m_key;
+        lua_any_t m_value;
+    };
+
+    /** @brief Table captured in a lua_any_arena, the array part 1..#t apart from the other entries. */
+    struct lua_any_table{
+        lua_any_t*     m_array;
+        std::size_t    m_array_size;
+        lua_any_entry* m_hash;
+        std::size_t    m_hash_size;
+
+        /** @brief String keys first, in lexicographic order, the other keys after them. */
+        static bool key_less(const lua_any_entry& left, const lua_any_entry& right){
+            if( left.m_key.m_lua_type != LUA_TSTRING || right.m_key.m_lua_type != LUA_TSTRING ){
+                return left.m_key.m_lua_type == LUA_TSTRING && right.m_key.m_lua_type != LUA_TSTRING;
+            }
+            return left.m_key.str() < right.m_key.str();
+        }
+
+        /** @brief Order the entries once captured, so that find is a binary search. */
+        void sort_entries(){
+            std::sort(m_hash, m_hash + m_hash_size, key_less);
+        }
+
+        /** @brief Return the value of the given string key, or null if there is none. */
+        const lua_any_t* find(std::string_view key) const{
+            const lua_any_entry* begin = m_hash;
+            const lua_any_entry* end = m_hash + m_hash_size;
+            const lua_any_entry* found = std::lower_bound(begin, end, key, [](const lua_any_entry& entry, std::string_view key){
+                return entry.m_key.m_lua_type == LUA_TSTRING && entry.m_key.str() < key;
+            });
+            if( found != end && found->m_key.m_lua_type == LUA_TSTRING && found->m_key.str() == key ){
+                return &found->m_value;
+            }
+            return nullptr;
+        }
+    };
+
+    /** @brief Tell if the key at the given index belongs to the array part 1..array_size. */
+    inline bool is_array_key(lua_State* L, int index, lua_Integer array_size){
+        int is_integer = 0;
+        lua_Integer key = lua_type(L, index) == LUA_TNUMBER ? lua_tointegerx(L, index, &is_integer) : 0;
+        return is_integer && key >= 1 && key <= array_size;
+    }
+
+    inline lua_any_table* lua_any_t::capture_table(lua_State* L, int index, lua_any_arena& arena, int visited, int depth){
+        index = lua_absindex(L, index);
+        luaL_checkstack(L, 4, "lua_bender::lua_any_t::capture_table");
+
+        lua_pushvalue(L, index);
+        if( lua_rawget(L, visited) == LUA_TLIGHTUSERDATA ){
+            lua_any_table* shared = static_cast<lua_any_table*>(lua_touserdata(L, -1));
+            lua_pop(L, 1);
+            return shared;
+        }
+        lua_pop(L, 1);
+
+        lua_any_table* res = arena.allocate_array<lua_any_table>(1);
+        lua_pushvalue(L, index);
+        lua_pushlightuserdata(L, res);
+        lua_rawset(L, visited);
+
+        // Counting first allows a single allocation per part.
+        lua_Integer array_size = lua_Integer(lua_rawlen(L, index));
+        std::size_t hash_size = 0;
+        lua_pushnil(L);
+        while( lua_next(L, index) ){
+            lua_pop(L, 1);
+            hash_size += is_array_key(L, -1, array_size) ? 0 : 1;
+        }
+
+        res->m_array = arena.allocate_array<lua_any_t>(std::size_t(array_size));
+        res->m_array_size = std::size_t(array_size);
+        res->m_hash = arena.allocate_array<lua_any_entry>(hash_size);
+        res->m_hash_size = hash_size;
+
+        for(lua_Integer i = 1; i <= array_size; ++i){
+            lua_rawgeti(L, index, i);
+            res->m_array[i - 1].read(L, -1, &arena, visited, depth + 1);
+            lua_pop(L, 1);
+        }
+
+        std::size_t entry = 0;
+        lua_pushnil(L);
+        while( lua_next(L, index) ){
+            if( !is_array_key(L, -2, array_size) ){
+                res->m_hash[entry].m_key.read(L, -2, &arena, visited, depth + 1);
+                res->m_hash[entry].m_value.read(L, -1, &arena, visited, depth + 1);
+                ++entry;
+            }
+            lua_pop(L, 1);
+        }
+        res->sort_entries();
+        return res;
+    }
 }
 
 #endif
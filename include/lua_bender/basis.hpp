@@ -86,6 +86,17 @@ namespace lua_bender{
         }
     };
 
+    // 64 bits integers, the default lua_Integer, are read without going through a double.
+    template<>
+    struct value<const long long&>{
+        static long long check(lua_State* L, int index){ return static_cast<long long>(luaL_checkinteger(L, index)); }
+
+        static int push(lua_State* L, long long value){
+            lua_pushinteger(L, lua_Integer(value));
+            return 1;
+        }
+    };
+
     template<>
     struct value<const bool&>{
         static bool check(lua_State* L, int index){ return lua_toboolean(L, index); }
@@ -118,6 +129,19 @@ namespace lua_bender{
             return 1;
         }
     };
+
+
+    // Enumerations are exchanged as Lua integers.
+    // The user_data.hpp value<const C&> template forwards enumeration types to this implementation.
+    template<typename E>
+    struct enum_value{
+        static E check(lua_State* L, int index){ return static_cast<E>(luaL_checkinteger(L, index)); }
+
+        static int push(lua_State* L, E value){
+            lua_pushinteger(L, static_cast<lua_Integer>(value));
+            return 1;
+        }
+    };
 }
 
 #pragma warning(pop)
@@ -0,0 +1,169 @@
+#ifndef LUA_BENDER_BATCH_HPP
+#define LUA_BENDER_BATCH_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "functions.hpp"
+#include "containers.hpp"
+#include "numeric_array.hpp"
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+
+// Batch adapters apply a bound function to whole arrays of arguments in a single call from Lua.
+// Each parameter accepts a Lua array, a typed numeric array (see numeric_array.hpp) of the same element type,
+// or a single value broadcast to every call. The function is then run in a native loop over the common length,
+// and the results are stored in an array allocated once: a typed array when the inputs came as typed arrays
+// and the typed array of the result type is bound in the state, a presized Lua table otherwise.
+//
+// double score(double x, double weight);
+// lua_CFunction f = lua_bender_batch_function(score); // score_batch({1, 2, 3}, 0.5) returns {score(1, 0.5), ...}
+
+#define lua_bender_batch_function(func) lua_bender::batch_function<&func>::adapter
+
+
+namespace lua_bender{
+    /** @brief Element types stored by the typed numeric arrays. */
+    template<typename T>
+    struct is_numeric_array_element{
+        static constexpr bool s_value = std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, std::int32_t>::value;
+    };
+
+    /** @brief Source of one parameter of a batch call: typed array, Lua array or broadcast value. */
+    template<typename T>
+    struct batch_argument{
+        typedef typename std::decay<T>::type element_type;
+        typedef decltype(value< typename add_const_ref<T>::type >::check(nullptr, 0)) check_type;
+
+        static constexpr bool s_arithmetic = std::is_arithmetic<element_type>::value;
+
+        int                 m_index;
+        // Length of the array, -1 for a broadcast value.
+        lua_Integer         m_size;
+        const element_type* m_data;
+        // Broadcast arithmetic values are read once.
+        typename std::conditional<s_arithmetic, element_type, char>::type m_scalar;
+
+        batch_argument(): m_index(), m_size(-1), m_data(), m_scalar(){}
+
+        /** @brief Inspect the argument at the given absolute index and return its length, -1 for a broadcast value. */
+        lua_Integer prepare(lua_State* L, int index){
+            m_index = index;
+            if constexpr( is_numeric_array_element<element_type>::s_value ){
+                numeric_array<element_type>* array = numeric_array<element_type>::test(L, index);
+                if( array != nullptr ){
+                    m_data = array->data();
+                    m_size = array->size();
+                    return m_size;
+                }
+            }
+
+            if( lua_type(L, index) == LUA_TTABLE && !struct_fields<element_type>::s_registered ){
+                m_size = lua_Integer(lua_rawlen(L, index));
+            }
+            else if constexpr( s_arithmetic ){
+                m_scalar = value< typename add_const_ref<T>::type >::check(L, index);
+            }
+            return m_size;
+        }
+
+        bool is_typed() const{ return m_data != nullptr; }
+
+        check_type get(lua_State* L, lua_Integer i){
+            if constexpr( s_arithmetic ){
+                if( m_data != nullptr ){
+                    return m_data[i];
+                }
+                return m_size >= 0 ? sequence_element<element_type>::check(L, m_index, i + 1) : m_scalar;
+            }
+            else{
+                if( m_size < 0 ){
+                    return value< typename add_const_ref<T>::type >::check(L, m_index);
+                }
+                // The table keeps the element alive once popped, so references to user data and strings remain valid.
+                lua_rawgeti(L, m_index, i + 1);
+                check_type res = value< typename add_const_ref<T>::type >::check(L, -1);
+                lua_pop(L, 1);
+                return res;
+            }
+        }
+    };
+
+
+    template<auto Fn> struct batch_function{};
+
+    template<typename R, typename ...Args, R(*func)(Args...)>
+    struct batch_function<func>{
+        typedef std::tuple< batch_argument<Args>... > arguments_type;
+
+        template<int ...list>
+        static lua_Integer prepare(lua_State* L, arguments_type& arguments, bool& typed, std::integer_sequence<int, list...>){
+            lua_Integer count = -1;
+            bool mismatch = false;
+            ((void)[&](lua_Integer size){
+                if( size >= 0 ){
+                    mismatch = mismatch || (count >= 0 && count != size);
+                    count = size;
+                }
+            }(std::get<list>(arguments).prepare(L, list + 1)), ...);
+
+            typed = (std::get<list>(arguments).is_typed() || ...);
+            if( mismatch ){
+                luaL_error(L, "lua_bender::batch_function the arrays must have the same length");
+            }
+            if( count < 0 ){
+                luaL_error(L, "lua_bender::batch_function at least one array is expected");
+            }
+            return count;
+        }
+
+        template<int ...list>
+        static int dispatch_function(lua_State* L, std::integer_sequence<int, list...> sequence){
+            arguments_type arguments;
+            bool typed = false;
+            lua_Integer count = prepare(L, arguments, typed, sequence);
+            luaL_checkstack(L, 2, "lua_bender::batch_function");
+
+            if constexpr( std::is_void<R>::value ){
+                for(lua_Integer i = 0; i < count; ++i){
+                    func(std::get<list>(arguments).get(L, i)...);
+                }
+                return 0;
+            }
+            else{
+                if constexpr( is_numeric_array_element<R>::s_value ){
+                    // Without the metatable of the result type in this state, the typed array would have no __gc and leak.
+                    const char* type_name = user_data_type_name< numeric_array<R> >::s_name.c_str();
+                    bool bound = false;
+                    if( typed ){
+                        bound = user_data::get_metatable(L, type_name) == LUA_TTABLE;
+                        lua_pop(L, 1);
+                    }
+                    if( bound ){
+                        numeric_array<R>* res = new numeric_array<R>(int(count));
+                        user_data::push(L, res, type_name, true);
+                        R* out = res->data();
+                        for(lua_Integer i = 0; i < count; ++i){
+                            out[i] = func(std::get<list>(arguments).get(L, i)...);
+                        }
+                        return 1;
+                    }
+                }
+
+                lua_createtable(L, int(count), 0);
+                for(lua_Integer i = 0; i < count; ++i){
+                    sequence_element<typename std::decay<R>::type>::push(L, func(std::get<list>(arguments).get(L, i)...));
+                    lua_rawseti(L, -2, i + 1);
+                }
+                return 1;
+            }
+        }
+
+        static int adapter(lua_State* L){
+            return dispatch_function(L, std::make_integer_sequence<int, sizeof...(Args)>());
+        }
+    };
+}
+
+#endif
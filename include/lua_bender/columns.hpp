@@ -0,0 +1,118 @@
+#ifndef LUA_BENDER_COLUMNS_HPP
+#define LUA_BENDER_COLUMNS_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "containers.hpp"
+#include <array>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+// Column schemas export an array of records built by a script into one std::vector per field (struct of arrays).
+// The field names are pushed once as Lua strings before walking the array. Short Lua strings being interned,
+// each field lookup then hashes and compares a string pointer with lua_rawget, instead of hashing the C string
+// again for every record as lua_getfield would.
+//
+// lua_bender::column_schema<float, float, int> schema("x", "y", "id");
+// auto columns = schema.extract(L, -1);   // { {x = 1, y = 2, id = 7}, ... }
+// std::vector<float>& xs = std::get<0>(columns);
+
+namespace lua_bender{
+    template<typename ...Ts>
+    struct column_schema{
+        typedef std::tuple< std::vector<Ts>... > columns_type;
+
+        static constexpr std::size_t s_column_count = sizeof...(Ts);
+
+        std::array<const char*, sizeof...(Ts)> m_names;
+
+        template<typename ...Names>
+        column_schema(Names... names): m_names{{ names... }}{
+            static_assert(sizeof...(Names) == sizeof...(Ts), "lua_bender::column_schema expects one name per column");
+        }
+
+        /** @brief Return the columns of the array of records located at the given index. */
+        columns_type extract(lua_State* L, int index) const{
+            columns_type res;
+            extract(L, index, res);
+            return res;
+        }
+
+        /**
+         * @brief Append the fields of the array of records located at the given index to the columns.
+         * Missing fields are appended as default values so that the columns keep the same length.
+         * luaL_error does not unwind the C++ frames, so every record is checked before the columns grow.
+         */
+        void extract(lua_State* L, int index, columns_type& columns) const{
+            index = lua_absindex(L, index);
+            luaL_checktype(L, index, LUA_TTABLE);
+            luaL_checkstack(L, int(s_column_count) + 3, "lua_bender::column_schema");
+
+            lua_Integer size = lua_Integer(lua_rawlen(L, index));
+            int keys = lua_gettop(L) + 1;
+            for(const char* name : m_names){
+                lua_pushstring(L, name);
+            }
+
+            for(lua_Integer i = 1; i <= size; ++i){
+                if( lua_rawgeti(L, index, i) != LUA_TTABLE ){
+                    luaL_error(L, "lua_bender::column_schema expected a table as record %d, got %s", int(i), luaL_typename(L, -1));
+                }
+                check_record(L, keys, std::index_sequence_for<Ts...>());
+                lua_pop(L, 1);
+            }
+
+            reserve(columns, std::size_t(size), std::index_sequence_for<Ts...>());
+            for(lua_Integer i = 1; i <= size; ++i){
+                lua_rawgeti(L, index, i);
+                append_record(L, keys, columns, std::index_sequence_for<Ts...>());
+                lua_pop(L, 1);
+            }
+            lua_pop(L, int(s_column_count));
+        }
+
+        template<std::size_t ...Is>
+        static void reserve(columns_type& columns, std::size_t size, std::index_sequence<Is...>){
+            (std::get<Is>(columns).reserve(std::get<Is>(columns).size() + size), ...);
+        }
+
+        /** @brief Raise an error if a field of the record on top of the stack cannot be read, the field names being at the keys index. */
+        template<std::size_t ...Is>
+        static void check_record(lua_State* L, int keys, std::index_sequence<Is...>){
+            (check_field<Is>(L, keys), ...);
+        }
+
+        template<std::size_t I>
+        static void check_field(lua_State* L, int keys){
+            typedef typename std::tuple_element<I, std::tuple<Ts...>>::type field_type;
+            lua_pushvalue(L, keys + int(I));
+            if( lua_rawget(L, -2) != LUA_TNIL && !is_valid_element<field_type>(L, -1) ){
+                sequence_element<field_type>::error_at(L, -1);
+            }
+            lua_pop(L, 1);
+        }
+
+        /** @brief Append the fields of the record on top of the stack, the field names being at the keys index. */
+        template<std::size_t ...Is>
+        static void append_record(lua_State* L, int keys, columns_type& columns, std::index_sequence<Is...>){
+            (append_field<Is>(L, keys, columns), ...);
+        }
+
+        template<std::size_t I>
+        static void append_field(lua_State* L, int keys, columns_type& columns){
+            typedef typename std::tuple_element<I, std::tuple<Ts...>>::type field_type;
+            lua_pushvalue(L, keys + int(I));
+            if( lua_rawget(L, -2) == LUA_TNIL ){
+                std::get<I>(columns).emplace_back();
+            }
+            else{
+                std::get<I>(columns).push_back(sequence_element<field_type>::check_at(L, -1));
+            }
+            lua_pop(L, 1);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef LUA_BENDER_CONTAINERS_HPP
+#define LUA_BENDER_CONTAINERS_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "functions.hpp"
+#include "user_data.hpp"
+#include <array>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+
+// This file extends the value template to the standard containers, which are exchanged with Lua as tables.
+// Sequences use the array part of the table, presized with lua_createtable and accessed with the raw functions
+// so that neither rehashing nor metamethods are involved.
+// Associative containers use the hash part of the table, presized for all the entries as well.
+
+namespace lua_bender{
+    /** @brief Push and read a single element of a Lua array, with a fast path for the arithmetic types. */
+    template<typename T>
+    struct sequence_element{
+        template<typename E>
+        static void push(lua_State* L, E&& element){
+            if constexpr( std::is_same<T, bool>::value ){
+                lua_pushboolean(L, element);
+            }
+            else if constexpr( std::is_integral<T>::value ){
+                lua_pushinteger(L, static_cast<lua_Integer>(element));
+            }
+            else if constexpr( std::is_floating_point<T>::value ){
+                lua_pushnumber(L, static_cast<lua_Number>(element));
+            }
+            else if constexpr( struct_fields<T>::s_registered ){
+                struct_fields<T>::push(L, element);
+            }
+            else{
+                value< typename add_const_ref<T>::type >::push(L, element);
+            }
+        }
+
+        /** @brief Read the element located at the given stack index. */
+        static T check_at(lua_State* L, int index){
+            if constexpr( std::is_same<T, bool>::value ){
+                return lua_toboolean(L, index);
+            }
+            else if constexpr( std::is_integral<T>::value || std::is_floating_point<T>::value ){
+                T res;
+                if( !try_at(L, index, res) ){
+                    error_at(L, index);
+                }
+                return res;
+            }
+            else if constexpr( struct_fields<T>::s_registered ){
+                T res;
+                struct_fields<T>::check(L, index, res);
+                return res;
+            }
+            else{
+                return value< typename add_const_ref<T>::type >::check(L, index);
+            }
+        }
+
+        /** @brief Convert the arithmetic element at the given stack index without raising an error, return false if it is not a number. */
+        static bool try_at(lua_State* L, int index, T& res){
+            static_assert(std::is_arithmetic<T>::value, "lua_bender::sequence_element::try_at only converts arithmetic types");
+            if constexpr( std::is_same<T, bool>::value ){
+                res = lua_toboolean(L, index) != 0;
+                return true;
+            }
+            else{
+                int is_number = 0;
+                res = std::is_integral<T>::value ? T(lua_tointegerx(L, index, &is_number)) : T(lua_tonumberx(L, index, &is_number));
+                return is_number != 0;
+            }
+        }
+
+        /** @brief Raise the error of an arithmetic element that try_at could not convert. */
+        static void error_at(lua_State* L, int index){
+            luaL_error(L, "expected a valid %s, got %s", std::is_integral<T>::value ? "integer" : "number", luaL_typename(L, index));
+        }
+
+        /** @brief Read the element at position i of the table located at the absolute index table. */
+        static T check(lua_State* L, int table, lua_Integer i){
+            lua_rawgeti(L, table, i);
+            T res = check_at(L, -1);
+            lua_pop(L, 1);
+            return res;
+        }
+    };
+
+    /** @brief Push any container with a size and random access as a presized Lua array. */
+    template<typename Container>
+    inline int push_sequence(lua_State* L, const Container& container){
+        typedef typename Container::value_type element_type;
+        int size = int(container.size());
+
+        luaL_checkstack(L, 2, "lua_bender::push_sequence");
+        lua_createtable(L, size, 0);
+        for(int i = 0; i < size; ++i){
+            sequence_element<element_type>::push(L, container[i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    /**
+     * @brief Append the elements of the Lua array located at the given index to a container.
+     * luaL_error does not unwind the C++ frames, so the container is released before raising on an arithmetic element
+     * that is not a number, instead of leaking its buffer.
+     */
+    template<typename Container>
+    inline void check_sequence(lua_State* L, int index, Container& container){
+        typedef typename Container::value_type element_type;
+        index = lua_absindex(L, index);
+        luaL_checktype(L, index, LUA_TTABLE);
+
+        lua_Integer size = lua_Integer(lua_rawlen(L, index));
+        luaL_checkstack(L, 2, "lua_bender::check_sequence");
+        for(lua_Integer i = 1; i <= size; ++i){
+            if constexpr( std::is_arithmetic<element_type>::value ){
+                element_type element;
+                lua_rawgeti(L, index, i);
+                if( !sequence_element<element_type>::try_at(L, -1, element) ){
+                    Container().swap(container);
+                    sequence_element<element_type>::error_at(L, -1);
+                }
+                lua_pop(L, 1);
+                container.push_back(element);
+            }
+            else{
+                container.push_back(sequence_element<element_type>::check(L, index, i));
+            }
+        }
+    }
+
+
+    /** @brief Push any associative container as a Lua table with a presized hash part. */
+    template<typename Map>
+    inline int push_associative(lua_State* L, const Map& container){
+        luaL_checkstack(L, 3, "lua_bender::push_associative");
+        lua_createtable(L, 0, int(container.size()));
+        for(const auto& entry : container){
+            sequence_element<typename Map::key_type>::push(L, entry.first);
+            sequence_element<typename Map::mapped_type>::push(L, entry.second);
+            lua_rawset(L, -3);
+        }
+        return 1;
+    }
+
+    /** @brief Check that sequence_element<T>::check_at will not raise on an arithmetic element, other types raise their own errors. */
+    template<typename T>
+    inline bool is_valid_element(lua_State* L, int index){
+        if constexpr( std::is_arithmetic<T>::value ){
+            T res;
+            return sequence_element<T>::try_at(L, index, res);
+        }
+        else{
+            return true;
+        }
+    }
+
+    /**
+     * @brief Insert the entries of the Lua table located at the given index in an associative container.
+     * As check_sequence, the container is released before raising on an arithmetic key or value that is not a number.
+     */
+    template<typename Map>
+    inline void check_associative(lua_State* L, int index, Map& container){
+        typedef typename Map::key_type    key_type;
+        typedef typename Map::mapped_type mapped_type;
+        index = lua_absindex(L, index);
+        luaL_checktype(L, index, LUA_TTABLE);
+        luaL_checkstack(L, 3, "lua_bender::check_associative");
+
+        lua_pushnil(L);
+        while( lua_next(L, index) ){
+            // Converting a number key to a string in place would break lua_next, so the key is read from a copy.
+            lua_pushvalue(L, -2);
+            if( !is_valid_element<key_type>(L, -1) ){
+                Map().swap(container);
+                sequence_element<key_type>::error_at(L, -1);
+            }
+            if( !is_valid_element<mapped_type>(L, -2) ){
+                Map().swap(container);
+                sequence_element<mapped_type>::error_at(L, -2);
+            }
+            key_type key = sequence_element<key_type>::check_at(L, -1);
+            container.emplace(std::move(key), sequence_element<mapped_type>::check_at(L, -2));
+            lua_pop(L, 2);
+        }
+    }
+
+
+    template<typename T>
+    struct value<const std::vector<T>&>{
+        static std::vector<T> check(lua_State* L, int index){
+            std::vector<T> res;
+            res.reserve(lua_type(L, index) == LUA_TTABLE ? lua_rawlen(L, index) : 0);
+            check_sequence(L, index, res);
+            return res;
+        }
+
+        static int push(lua_State* L, const std::vector<T>& value){
+            return push_sequence(L, value);
+        }
+    };
+
+    template<typename T>
+    struct value<const std::deque<T>&>{
+        static std::deque<T> check(lua_State* L, int index){
+            std::deque<T> res;
+            check_sequence(L, index, res);
+            return res;
+        }
+
+        static int push(lua_State* L, const std::deque<T>& value){
+            return push_sequence(L, value);
+        }
+    };
+
+    template<typename T, std::size_t N>
+    struct value<const std::array<T, N>&>{
+        static std::array<T, N> check(lua_State* L, int index){
+            std::array<T, N> res;
+            index = lua_absindex(L, index);
+            luaL_checktype(L, index, LUA_TTABLE);
+            if( lua_rawlen(L, index) != N ){
+                luaL_error(L, "expected an array of %d elements, got %d", int(N), int(lua_rawlen(L, index)));
+            }
+
+            luaL_checkstack(L, 2, "lua_bender::value<std::array>");
+            for(std::size_t i = 0; i < N; ++i){
+                res[i] = sequence_element<T>::check(L, index, lua_Integer(i + 1));
+            }
+            return res;
+        }
+
+        static int push(lua_State* L, const std::array<T, N>& value){
+            return push_sequence(L, value);
+        }
+    };
+
+    template<typename K, typename V>
+    struct value<const std::map<K, V>&>{
+        static std::map<K, V> check(lua_State* L, int index){
+            std::map<K, V> res;
+            check_associative(L, index, res);
+            return res;
+        }
+
+        static int push(lua_State* L, const std::map<K, V>& value){
+            return push_associative(L, value);
+        }
+    };
+
+    template<typename K, typename V>
+    struct value<const std::unordered_map<K, V>&>{
+        static std::unordered_map<K, V> check(lua_State* L, int index){
+            // Lua does not expose the number of entries of a table, the map grows while the table is read in a single pass.
+            std::unordered_map<K, V> res;
+            check_associative(L, index, res);
+            return res;
+        }
+
+        static int push(lua_State* L, const std::unordered_map<K, V>& value){
+            return push_associative(L, value);
+        }
+    };
+}
+
+#endif
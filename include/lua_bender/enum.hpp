@@ -0,0 +1,75 @@
+#ifndef LUA_BENDER_ENUM_HPP
+#define LUA_BENDER_ENUM_HPP
+#pragma once
+
+#include "basis.hpp"
+#include <cstddef>
+
+// Enumeration values are marshalled as integers by the value template (see basis.hpp).
+// This file provides helpers to expose the names of an enumeration to Lua as a read-only table of integers.
+//
+// static constexpr lua_bender::enum_entry<color> color_entries[] = {
+//     {"red", color::red}, {"green", color::green}, {"blue", color::blue}
+// };
+// lua_bender::bind_enum(L, "color", color_entries);
+
+namespace lua_bender{
+    template<typename E>
+    struct enum_entry{
+        const char* m_name;
+        E           m_value;
+    };
+
+    /** @brief __newindex of the enumeration tables. */
+    inline int enum_table_newindex(lua_State* L){
+        return luaL_error(L, "attempt to modify the read-only enumeration field %s", luaL_tolstring(L, 2, nullptr));
+    }
+
+    /** @brief __pairs of the enumeration tables, iterates over the values table rather than the empty proxy. */
+    inline int enum_table_pairs(lua_State* L){
+        lua_getglobal(L, "next");
+        luaL_getmetafield(L, 1, "__index");
+        lua_pushnil(L);
+        return 3;
+    }
+
+    /**
+     * @brief Push a read-only table mapping the names to the values of the given entries.
+     * The values are stored in a single table presized for all the entries, used as __index of the empty proxy table
+     * actually pushed.
+     */
+    template<typename E>
+    void push_enum_table(lua_State* L, const enum_entry<E>* entries, std::size_t count){
+        lua_newtable(L);
+        lua_createtable(L, 0, 4);
+
+        lua_createtable(L, 0, int(count));
+        for(std::size_t i = 0; i < count; ++i){
+            lua_pushinteger(L, static_cast<lua_Integer>(entries[i].m_value));
+            lua_setfield(L, -2, entries[i].m_name);
+        }
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, enum_table_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, enum_table_pairs);
+        lua_setfield(L, -2, "__pairs");
+        lua_pushboolean(L, false);
+        lua_setfield(L, -2, "__metatable");
+        lua_setmetatable(L, -2);
+    }
+
+    template<typename E, std::size_t N>
+    void push_enum_table(lua_State* L, const enum_entry<E> (&entries)[N]){
+        push_enum_table(L, entries, N);
+    }
+
+    /** @brief Bind a read-only enumeration table under the given global name. */
+    template<typename E, std::size_t N>
+    void bind_enum(lua_State* L, const char* name, const enum_entry<E> (&entries)[N]){
+        push_enum_table(L, entries, N);
+        lua_setglobal(L, name);
+    }
+}
+
+#endif
@@ -72,9 +72,9 @@ namespace lua_bender{
     // in order to locate the argument in the Lua stack by index.
     // Finally each argument and return type get temporaries const ref qualifiers just to point them to the same value template implementation.
 
-    // This template system is then specialized for 6 cases.
-    // The first two are for classic function with and without returned value.
-    // The last four after are the same than the previous two but for member functions with either a constant or not instance caller.
+    // This template system is then specialized for 3 cases: classic functions, and member functions with either
+    // a constant or not instance caller. Functions without returned value are handled by the same specializations,
+    // a separate void specialization being ambiguous with the generic one on some compilers.
 
 
     template<auto Fn> struct function{};
@@ -83,82 +83,43 @@ namespace lua_bender{
     struct function<func>{
         template<int ...list>
         static int dispatch_function(lua_State* L, std::integer_sequence<int, list...>){
-            return value< typename add_const_ref<R>::type >::push(L, func(value< typename add_const_ref<Args>::type >::check(L,  -sizeof...(Args) + list)...));
+            if constexpr( std::is_void<R>::value ){
+                func(value< typename add_const_ref<Args>::type >::check(L, -int(sizeof...(Args)) + list)...);
+                return 0;
+            }
+            else{
+                return value< typename add_const_ref<R>::type >::push(L, func(value< typename add_const_ref<Args>::type >::check(L,  -int(sizeof...(Args)) + list)...));
+            }
         }
 
 
         static int adapter(lua_State* L){
+            // Omitted trailing arguments are read as nil, instead of the values below the arguments.
+            if( lua_gettop(L) < int(sizeof...(Args)) ){
+                lua_settop(L, int(sizeof...(Args)));
+            }
             return dispatch_function(L, std::make_integer_sequence<int, sizeof...(Args)>());
         }
     };
 
-    template<typename ...Args, void(*func)(Args...)>
-    struct function<func>{
-        template<int ...list>
-        static void dispatch_function(lua_State* L, std::integer_sequence<int, list...>){
-            func(lua_bender::value< typename add_const_ref<Args>::type >::check(L, -sizeof...(Args) + list)...);
-        }
-
-        static int adapter(lua_State* L){
-            dispatch_function(L, std::make_integer_sequence<int, sizeof...(Args)>());
-            return 0;
-        }
-    };
-
 
     // ******************************** MEMBER FUNCTIONS ADAPTERS ********************************
 
 
-   template<auto Fn> struct member_function{};
+    template<auto Fn> struct member_function{};
 
-    template<class C, typename R, typename ...Args, R(C::*func)(Args...)>
-    struct member_function<func>{
+    /** @brief Common part of the member function adapters, C being the caller type and R the returned type of func. */
+    template<class C, typename R, auto func, typename ...Args>
+    struct member_function_adapter{
         template<int ...list>
         static int dispatch_function(lua_State* L, C* caller, std::integer_sequence<int, list...>){
-            return value< typename add_const_ref<R>::type >::push(L, (caller->*func)(value< typename add_const_ref<Args>::type >::check(L, -sizeof...(Args) + list)...));
-        }
-
-
-        static int adapter(lua_State* L){
-            user_data* udata = user_data::check(L, 1);
-            if( udata == nullptr || udata->m_data == nullptr ){
-                LUA_BENDER_LOG_ERROR("Could not get the caller from the lua stack");
-            }
-
-            C* caller = static_cast<C*>(udata->m_data);
-            return dispatch_function(L, caller, std::make_integer_sequence<int, sizeof...(Args)>());
-        }
-    };
-
-
-    template<class C, typename ...Args, void(C::*func)(Args...)>
-    struct member_function<func>{
-        template<int ...list>
-        static void dispatch_function(lua_State* L, C* caller, std::integer_sequence<int, list...>){
-            (caller->*func)(value< typename add_const_ref<Args>::type >::check(L, -sizeof...(Args) + list)...);
-        }
-
-        static int adapter(lua_State* L){
-            user_data* udata = user_data::check(L, 1);
-            if( udata == nullptr || udata->m_data == nullptr ){
-                LUA_BENDER_LOG_ERROR("Could not get a caller from the lua stack");
+            if constexpr( std::is_void<R>::value ){
+                (caller->*func)(value< typename add_const_ref<Args>::type >::check(L, -int(sizeof...(Args)) + list)...);
                 return 0;
             }
-
-            C* caller = static_cast<C*>(udata->m_data);
-            dispatch_function(L, caller, std::make_integer_sequence<int, sizeof...(Args)>());
-            return 0;
-        }
-    };
-
-
-
-
-    template<class C, typename R, typename ...Args, R(C::*func)(Args...) const>
-    struct member_function<func>{
-        template<int ...list>
-        static int dispatch_function(lua_State* L, C* caller, std::integer_sequence<int, list...>){
-            return value< typename add_const_ref<R>::type >::push(L, (caller->*func)(value< typename add_const_ref<Args>::type >::check(L, -sizeof...(Args) + list)...));
+            else{
+                return value< typename add_const_ref<R>::type >::push(L, (caller->*func)(value< typename add_const_ref<Args>::type >::check(L, -int(sizeof...(Args)) + list)...));
+            }
         }
 
 
@@ -166,33 +127,22 @@ namespace lua_bender{
             user_data* udata = user_data::check(L, 1);
             if( udata == nullptr || udata->m_data == nullptr ){
                 LUA_BENDER_LOG_ERROR("Could not get the caller from the lua stack");
+                return 0;
             }
 
             C* caller = static_cast<C*>(udata->m_data);
+            if( lua_gettop(L) < int(sizeof...(Args)) + 1 ){
+                lua_settop(L, int(sizeof...(Args)) + 1);
+            }
             return dispatch_function(L, caller, std::make_integer_sequence<int, sizeof...(Args)>());
         }
     };
 
+    template<class C, typename R, typename ...Args, R(C::*func)(Args...)>
+    struct member_function<func> : member_function_adapter<C, R, func, Args...>{};
 
-    template<class C, typename ...Args, void(C::*func)(Args...) const>
-    struct member_function<func>{
-        template<int ...list>
-        static void dispatch_function(lua_State* L, C* caller, std::integer_sequence<int, list...>){
-            (caller->*func)(value< typename add_const_ref<Args>::type >::check(L, -sizeof...(Args) + list)...);
-        }
-
-        static int adapter(lua_State* L){
-            user_data* udata = user_data::check(L, 1);
-            if( udata == nullptr || udata->m_data == nullptr ){
-                LUA_BENDER_LOG_ERROR("Could not get a caller from the lua stack");
-                return 0;
-            }
-
-            C* caller = static_cast<C*>(udata->m_data);
-            dispatch_function(L, caller, std::make_integer_sequence<int, sizeof...(Args)>());
-            return 0;
-        }
-    };
+    template<class C, typename R, typename ...Args, R(C::*func)(Args...) const>
+    struct member_function<func> : member_function_adapter<C, R, func, Args...>{};
 
     /** @brief Generate a copy accessor to a data member of a given structure using pointer logic. */
     template<class C, typename mtype, int offset>
@@ -0,0 +1,196 @@
+#ifndef LUA_BENDER_ITERATOR_HPP
+#define LUA_BENDER_ITERATOR_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "containers.hpp"
+#include <iterator>
+#include <new>
+#include <optional>
+#include <utility>
+
+
+// This file turns C++ ranges and generators into Lua iterator functions, used by the generic for loop:
+//
+// lua_bender::iterator_range<std::vector<int>::const_iterator> get_ids(){ return lua_bender::make_iterator_range(ids.begin(), ids.end()); }
+//
+// for id in get_ids() do print(id) end
+//
+// The iteration state is stored inline in a user data kept as the only upvalue of the iterator closure, and the
+// elements are converted one at a time, so streaming over a range never materializes a table.
+// Iterating over pairs (e.g. map entries) yields the key and the value as two loop variables.
+
+namespace lua_bender{
+    /** @brief Pair of iterators borrowing a range, which must outlive the loop. */
+    template<typename Iterator, typename Sentinel = Iterator>
+    struct iterator_range{
+        Iterator m_begin;
+        Sentinel m_end;
+    };
+
+    template<typename Iterator, typename Sentinel>
+    inline iterator_range<Iterator, Sentinel> make_iterator_range(Iterator begin, Sentinel end){
+        return iterator_range<Iterator, Sentinel>{ begin, end };
+    }
+
+    /** @brief Function computing the elements on demand, returning an empty std::optional to end the loop. */
+    template<typename Fn>
+    struct generator{
+        Fn m_next;
+    };
+
+    template<typename Fn>
+    inline generator<Fn> make_generator(Fn next){
+        return generator<Fn>{ std::move(next) };
+    }
+
+
+    /** @brief Push an element produced by an iteration, the pairs being pushed as two values. */
+    template<typename T>
+    inline int push_iterated(lua_State* L, const T& element){
+        sequence_element<T>::push(L, element);
+        return 1;
+    }
+
+    template<typename K, typename V>
+    inline int push_iterated(lua_State* L, const std::pair<K, V>& element){
+        sequence_element<typename std::decay<K>::type>::push(L, element.first);
+        sequence_element<V>::push(L, element.second);
+        return 2;
+    }
+
+
+    // ******************************** STATES ********************************
+
+    template<typename Iterator, typename Sentinel>
+    struct iterator_state{
+        typedef typename std::iterator_traits<Iterator>::value_type element_type;
+
+        Iterator m_current;
+        Sentinel m_end;
+
+        iterator_state(Iterator begin, Sentinel end): m_current(std::move(begin)), m_end(std::move(end)){}
+
+        int next(lua_State* L){
+            if( m_current == m_end ){
+                return 0;
+            }
+            // Converting first lets the proxies, such as the std::vector<bool> ones, be pushed as their value type.
+            const element_type& element = *m_current;
+            int count = push_iterated(L, element);
+            ++m_current;
+            return count;
+        }
+    };
+
+    /** @brief State owning the range itself, for temporaries and lazily computed ranges. */
+    template<typename Range>
+    struct range_state{
+        typedef decltype(std::begin(std::declval<Range&>())) iterator_type;
+        typedef decltype(std::end(std::declval<Range&>()))   sentinel_type;
+        typedef typename std::iterator_traits<iterator_type>::value_type element_type;
+
+        Range         m_range;
+        iterator_type m_current;
+        sentinel_type m_end;
+
+        range_state(Range&& range): m_range(std::move(range)), m_current(std::begin(m_range)), m_end(std::end(m_range)){}
+
+        int next(lua_State* L){
+            if( m_current == m_end ){
+                return 0;
+            }
+            const element_type& element = *m_current;
+            int count = push_iterated(L, element);
+            ++m_current;
+            return count;
+        }
+    };
+
+    template<typename Fn>
+    struct generator_state{
+        Fn m_next;
+
+        generator_state(Fn next): m_next(std::move(next)){}
+
+        int next(lua_State* L){
+            auto element = m_next();
+            if( !element ){
+                return 0;
+            }
+            return push_iterated(L, *element);
+        }
+    };
+
+    /** @brief Iterator closure whose upvalue is a user data storing the State, destroyed by its __gc. */
+    template<class State>
+    struct iterator_closure{
+        // Only the address matters, used as registry key of the metatable.
+        static inline const char s_metatable_key = 0;
+
+        template<typename ...Args>
+        static int push(lua_State* L, Args&&... args){
+            luaL_checkstack(L, 2, "lua_bender::iterator_closure");
+            State* state = static_cast<State*>(lua_newuserdata(L, sizeof(State)));
+            new (state) State(std::forward<Args>(args)...);
+
+            if( lua_rawgetp(L, LUA_REGISTRYINDEX, &s_metatable_key) == LUA_TNIL ){
+                lua_pop(L, 1);
+                lua_createtable(L, 0, 1);
+                lua_pushcfunction(L, destroy);
+                lua_setfield(L, -2, "__gc");
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, LUA_REGISTRYINDEX, &s_metatable_key);
+            }
+            lua_setmetatable(L, -2);
+
+            lua_pushcclosure(L, next, 1);
+            return 1;
+        }
+
+        static int next(lua_State* L){
+            return static_cast<State*>(lua_touserdata(L, lua_upvalueindex(1)))->next(L);
+        }
+
+        static int destroy(lua_State* L){
+            static_cast<State*>(lua_touserdata(L, 1))->~State();
+            return 0;
+        }
+    };
+
+
+    /** @brief Push an iterator function over [begin, end), the range must outlive the loop. */
+    template<typename Iterator, typename Sentinel>
+    inline int push_iterator(lua_State* L, Iterator begin, Sentinel end){
+        return iterator_closure< iterator_state<Iterator, Sentinel> >::push(L, std::move(begin), std::move(end));
+    }
+
+    /** @brief Push an iterator function over a range moved into the iteration state. */
+    template<typename Range>
+    inline int push_range(lua_State* L, Range range){
+        return iterator_closure< range_state<Range> >::push(L, std::move(range));
+    }
+
+    /** @brief Push an iterator function calling next until it returns an empty std::optional. */
+    template<typename Fn>
+    inline int push_generator(lua_State* L, Fn next){
+        return iterator_closure< generator_state<Fn> >::push(L, std::move(next));
+    }
+
+
+    template<typename Iterator, typename Sentinel>
+    struct value<const iterator_range<Iterator, Sentinel>&>{
+        static int push(lua_State* L, const iterator_range<Iterator, Sentinel>& value){
+            return push_iterator(L, value.m_begin, value.m_end);
+        }
+    };
+
+    template<typename Fn>
+    struct value<const generator<Fn>&>{
+        static int push(lua_State* L, const generator<Fn>& value){
+            return push_generator(L, value.m_next);
+        }
+    };
+}
+
+#endif
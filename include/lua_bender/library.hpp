@@ -6,17 +6,26 @@
 #include "functions.hpp"
 #include "metatable.hpp"
 
+// Registry field holding the lazy_binding_stats of a state.
+#define LUA_BENDER_LAZY_STATS "lua_bender.lazy_stats"
+
 namespace lua_bender{
+    /** @brief Counters of the metatables bound lazily to a given state. */
+    struct lazy_binding_stats{
+        int m_registered;
+        int m_materialized;
+    };
 
 
     struct lua_library{
         std::unordered_map<std::string, const lua_metatable*> m_metatables_reg;
         std::unordered_map<std::string, luaL_Reg>       m_functions_reg;
+        std::unordered_map<std::string, std::unordered_map<std::string, luaL_Reg>> m_namespaces_reg;
 
-        lua_library(): m_metatables_reg(), m_functions_reg(){}
+        lua_library(): m_metatables_reg(), m_functions_reg(), m_namespaces_reg(){}
 
 
-        lua_library(const std::vector<lua_metatable*>& metatables, const std::vector<luaL_Reg>& functions): m_metatables_reg(), m_functions_reg(){
+        lua_library(const std::vector<lua_metatable*>& metatables, const std::vector<luaL_Reg>& functions): m_metatables_reg(), m_functions_reg(), m_namespaces_reg(){
             for(const lua_metatable* table : metatables){
                 if( table != nullptr){
                     m_metatables_reg.insert({table->get_name(), table});
@@ -38,6 +47,107 @@ namespace lua_bender{
             for(const auto& entry : m_functions_reg){
                 lua_bender::bind_function(L, entry.first.c_str(), entry.second.func);
             }
+
+            // Register each namespace as a global table.
+            for(const auto& ns : m_namespaces_reg){
+                lua_createtable(L, 0, int(ns.second.size()));
+                for(const auto& entry : ns.second){
+                    lua_pushcfunction(L, entry.second.func);
+                    lua_setfield(L, -2, entry.first.c_str());
+                }
+                lua_setglobal(L, ns.first.c_str());
+            }
+        }
+
+        /**
+         * @brief Bind the library while only installing a loader stub for each metatable.
+         * The complete metatable (functions, __index and global) is created the first time the type is pushed
+         * or its global is read. The metatables must outlive the state.
+         */
+        void bind_lazy(lua_State* L) const{
+            bind_lazy_metatables(L);
+
+            // Register all global functions.
+            for(const auto& entry : m_functions_reg){
+                lua_bender::bind_function(L, entry.first.c_str(), entry.second.func);
+            }
+
+            // Namespaces are filled on first access.
+            for(const auto& ns : m_namespaces_reg){
+                push_module(L, ns.first.c_str());
+                lua_setglobal(L, ns.first.c_str());
+            }
+        }
+
+        /**
+         * @brief Bind the library as a single global module table instead of one global per function.
+         * Functions and namespaces are looked up in the library and cached in the module table on first access,
+         * metatables are bound lazily. The library must outlive the state.
+         */
+        void bind_module(lua_State* L, const char* name) const{
+            bind_lazy_metatables(L);
+            push_module(L, nullptr);
+
+            // Also make the module available to require.
+            luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+            lua_pushvalue(L, -2);
+            lua_setfield(L, -2, name);
+            lua_pop(L, 1);
+
+            lua_setglobal(L, name);
+        }
+
+        /**
+         * @brief Register the library in package.preload so that nothing is bound before require(name) is called.
+         * The package library must be opened first. The library must outlive the state.
+         */
+        void preload_module(lua_State* L, const char* name) const{
+            luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+            lua_pushlightuserdata(L, const_cast<lua_library*>(this));
+            lua_pushcclosure(L, module_loader, 1);
+            lua_setfield(L, -2, name);
+            lua_pop(L, 1);
+        }
+
+        /** @brief Push a module table populated on first access, for the given namespace or the global functions if null. */
+        void push_module(lua_State* L, const char* ns) const{
+            lua_newtable(L);
+            lua_createtable(L, 0, 1);
+            lua_pushlightuserdata(L, const_cast<lua_library*>(this));
+            if( ns != nullptr ){
+                lua_pushstring(L, ns);
+            }
+            else{
+                lua_pushnil(L);
+            }
+            lua_pushcclosure(L, module_index, 2);
+            lua_setfield(L, -2, "__index");
+            lua_setmetatable(L, -2);
+        }
+
+        /** @brief Install the loader stubs of all the metatables, see bind_lazy. */
+        void bind_lazy_metatables(lua_State* L) const{
+            lazy_binding_stats* stats = get_lazy_stats_data(L);
+            install_lazy_loaders(L);
+
+            lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_METATABLES);
+            for(const auto& entry : m_metatables_reg){
+                lua_pushlightuserdata(L, const_cast<lua_metatable*>(entry.second));
+                lua_pushcclosure(L, lazy_metatable_loader, 1);
+                lua_setfield(L, -2, entry.first.c_str());
+                ++stats->m_registered;
+            }
+            lua_pop(L, 1);
+        }
+
+        /** @brief Return how many metatables were bound lazily to the given state and how many were actually used. */
+        static lazy_binding_stats get_lazy_stats(lua_State* L){
+            lazy_binding_stats res = {0, 0};
+            if( lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_STATS) == LUA_TUSERDATA ){
+                res = *static_cast<lazy_binding_stats*>(lua_touserdata(L, -1));
+            }
+            lua_pop(L, 1);
+            return res;
         }
 
         void set_metatable(const lua_metatable* table, const char* name){
@@ -80,6 +190,156 @@ namespace lua_bender{
         void remove_function(const char* name){
              m_functions_reg.erase(name);
         }
+
+        /** @brief Add a function to the given namespace, bound as a table of functions named after it. */
+        void set_function(const char* ns, const luaL_Reg& reg){
+            m_namespaces_reg[ns][reg.name] = reg;
+        }
+
+        void remove_function(const char* ns, const char* name){
+            auto entry = m_namespaces_reg.find(ns);
+            if( entry != m_namespaces_reg.end() ){
+                entry->second.erase(name);
+                if( entry->second.empty() ){
+                    m_namespaces_reg.erase(entry);
+                }
+            }
+        }
+
+        /** @brief __index of the module tables, upvalue 1 is the library and upvalue 2 the namespace name or nil. */
+        static int module_index(lua_State* L){
+            const lua_library* lib = static_cast<const lua_library*>(lua_touserdata(L, lua_upvalueindex(1)));
+            const char* key = lua_type(L, 2) == LUA_TSTRING ? lua_tostring(L, 2) : nullptr;
+            if( key == nullptr ){
+                lua_pushnil(L);
+                return 1;
+            }
+
+            const std::unordered_map<std::string, luaL_Reg>* functions = &lib->m_functions_reg;
+            bool is_root = lua_isnil(L, lua_upvalueindex(2));
+            if( !is_root ){
+                auto ns = lib->m_namespaces_reg.find(lua_tostring(L, lua_upvalueindex(2)));
+                functions = ns != lib->m_namespaces_reg.end() ? &ns->second : nullptr;
+            }
+
+            const luaL_Reg* reg = nullptr;
+            if( functions != nullptr ){
+                auto entry = functions->find(key);
+                reg = entry != functions->end() ? &entry->second : nullptr;
+            }
+
+            if( reg != nullptr ){
+                lua_pushcfunction(L, reg->func);
+            }
+            else if( is_root && lib->m_namespaces_reg.count(key) != 0 ){
+                lib->push_module(L, key);
+            }
+            else{
+                lua_pushnil(L);
+                return 1;
+            }
+
+            // Cache the value in the module table so that the next accesses do not reach this function.
+            lua_pushvalue(L, 2);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, 1);
+            return 1;
+        }
+
+        /** @brief package.preload entry, upvalue 1 is the library. */
+        static int module_loader(lua_State* L){
+            const lua_library* lib = static_cast<const lua_library*>(lua_touserdata(L, lua_upvalueindex(1)));
+            lib->bind_lazy_metatables(L);
+            lib->push_module(L, nullptr);
+            return 1;
+        }
+
+        static lazy_binding_stats* get_lazy_stats_data(lua_State* L){
+            lazy_binding_stats* stats;
+            if( lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_STATS) == LUA_TUSERDATA ){
+                stats = static_cast<lazy_binding_stats*>(lua_touserdata(L, -1));
+            }
+            else{
+                lua_pop(L, 1);
+                stats = static_cast<lazy_binding_stats*>(lua_newuserdata(L, sizeof(lazy_binding_stats)));
+                stats->m_registered   = 0;
+                stats->m_materialized = 0;
+                lua_pushvalue(L, -1);
+                lua_setfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_STATS);
+            }
+            lua_pop(L, 1);
+            return stats;
+        }
+
+        /** @brief Create the loaders registry table and hook the global table on the first lazy binding of a state. */
+        static void install_lazy_loaders(lua_State* L){
+            if( lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_METATABLES) == LUA_TTABLE ){
+                lua_pop(L, 1);
+                return;
+            }
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_setfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_METATABLES);
+
+            // Reading an unknown global falls back to the loaders, then to any previous __index of the global table.
+            lua_pushglobaltable(L);
+            if( !lua_getmetatable(L, -1) ){
+                lua_newtable(L);
+                lua_pushvalue(L, -1);
+                lua_setmetatable(L, -3);
+            }
+            lua_getfield(L, -1, "__index");
+            lua_pushcclosure(L, lazy_global_index, 1);
+            lua_setfield(L, -2, "__index");
+            lua_pop(L, 2);
+        }
+
+        /** @brief Loader stub of a single metatable, upvalue 1 is the lua_metatable to create. */
+        static int lazy_metatable_loader(lua_State* L){
+            const lua_metatable* table = static_cast<const lua_metatable*>(lua_touserdata(L, lua_upvalueindex(1)));
+
+            // Loaders are one shot, the registry metatable takes over from now on.
+            lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_METATABLES);
+            lua_pushnil(L);
+            lua_setfield(L, -2, table->get_name().c_str());
+            lua_pop(L, 1);
+
+            table->create_metatable(L);
+            ++get_lazy_stats_data(L)->m_materialized;
+            return 0;
+        }
+
+        /** @brief __index of the global table, upvalue 1 is the previous __index if any. */
+        static int lazy_global_index(lua_State* L){
+            if( lua_type(L, 2) == LUA_TSTRING ){
+                lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_METATABLES);
+                lua_pushvalue(L, 2);
+                if( lua_rawget(L, -2) == LUA_TFUNCTION ){
+                    lua_call(L, 0, 0);
+                    lua_pop(L, 1);
+                    lua_pushvalue(L, 2);
+                    lua_rawget(L, 1);
+                    return 1;
+                }
+                lua_pop(L, 2);
+            }
+
+            switch( lua_type(L, lua_upvalueindex(1)) ){
+                case LUA_TFUNCTION:
+                    lua_pushvalue(L, lua_upvalueindex(1));
+                    lua_pushvalue(L, 1);
+                    lua_pushvalue(L, 2);
+                    lua_call(L, 2, 1);
+                    return 1;
+                case LUA_TTABLE:
+                    lua_pushvalue(L, 2);
+                    lua_gettable(L, lua_upvalueindex(1));
+                    return 1;
+                default:
+                    lua_pushnil(L);
+                    return 1;
+            }
+        }
     };
 
 }
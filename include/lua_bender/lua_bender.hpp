@@ -3,11 +3,26 @@
 #pragma once
 
 #include "basis.hpp"
+#include "ref.hpp"
 #include "any.hpp"
 #include "functions.hpp"
 #include "metatable.hpp"
 #include "user_data.hpp"
+#include "mapped_file.hpp"
 #include "script.hpp"
 #include "library.hpp"
+#include "enum.hpp"
+#include "containers.hpp"
+#include "views.hpp"
+#include "numeric_array.hpp"
+#include "struct_table.hpp"
+#include "optional.hpp"
+#include "batch.hpp"
+#include "columns.hpp"
+#include "string_builder.hpp"
+#include "iterator.hpp"
+#include "visitor.hpp"
+#include "serialization.hpp"
+#include "transfer.hpp"
 
 #endif
@@ -0,0 +1,151 @@
+#ifndef LUA_BENDER_MAPPED_FILE_HPP
+#define LUA_BENDER_MAPPED_FILE_HPP
+#pragma once
+
+#include "basis.hpp"
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+// Script files are memory mapped and given to lua_load in a single chunk, instead of being read through
+// the buffered stdio calls of luaL_loadfile, so large generated scripts are neither copied nor read byte per byte.
+// As luaL_loadfile, a UTF-8 BOM and a first line starting with # are skipped, keeping the line numbers.
+// Unlike luaL_loadfile, a file truncated by another process while it is mapped raises SIGBUS on POSIX systems
+// instead of a read error, so the scripts should be replaced by renaming a new file rather than rewritten in place.
+//
+// lua_bender::mapped_file file("data.lua");
+// if( file.load(L, "@data.lua") == LUA_OK ) ...
+
+namespace lua_bender{
+    /** @brief lua_Reader state giving the whole range to lua_load in a single call. */
+    struct chunk_reader{
+        const char* m_data;
+        size_t      m_size;
+
+        static const char* read(lua_State*, void* data, size_t* size){
+            chunk_reader* reader = static_cast<chunk_reader*>(data);
+            *size = reader->m_size;
+            reader->m_size = 0;
+            return *size > 0 ? reader->m_data : nullptr;
+        }
+    };
+
+    /** @brief Read-only memory mapping of a whole file, unmapped on destruction. */
+    struct mapped_file{
+        const char* m_data;
+        size_t      m_size;
+        bool        m_opened;
+#ifdef _WIN32
+        HANDLE      m_file;
+        HANDLE      m_mapping;
+#endif
+
+        explicit mapped_file(const char* path): m_data(), m_size(), m_opened(){
+#ifdef _WIN32
+            m_mapping = nullptr;
+            m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if( m_file == INVALID_HANDLE_VALUE ){
+                return;
+            }
+            LARGE_INTEGER size;
+            if( !GetFileSizeEx(m_file, &size) ){
+                return;
+            }
+            m_opened = true;
+            // Empty files cannot be mapped, they are kept as an empty range.
+            if( size.QuadPart == 0 ){
+                return;
+            }
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_data = m_mapping ? static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            m_size = size_t(size.QuadPart);
+#else
+            int descriptor = open(path, O_RDONLY);
+            if( descriptor < 0 ){
+                return;
+            }
+            struct stat status;
+            if( fstat(descriptor, &status) == 0 ){
+                m_opened = true;
+                m_size = size_t(status.st_size);
+                if( m_size > 0 ){
+                    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                    m_data = data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+                }
+            }
+            // The mapping stays valid once the descriptor is closed.
+            close(descriptor);
+#endif
+            if( m_size > 0 && m_data == nullptr ){
+                m_opened = false;
+                m_size = 0;
+            }
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file(){
+#ifdef _WIN32
+            if( m_data != nullptr ){
+                UnmapViewOfFile(m_data);
+            }
+            if( m_mapping != nullptr ){
+                CloseHandle(m_mapping);
+            }
+            if( m_file != INVALID_HANDLE_VALUE ){
+                CloseHandle(m_file);
+            }
+#else
+            if( m_data != nullptr ){
+                munmap(const_cast<char*>(m_data), m_size);
+            }
+#endif
+        }
+
+        bool valid() const{ return m_opened; }
+
+        /** @brief Offset of the chunk, after the UTF-8 BOM and the first line if it starts with #, whose line break is kept for text chunks. */
+        size_t chunk_offset() const{
+            size_t offset = 0;
+            if( m_size >= 3 && memcmp(m_data, "\xEF\xBB\xBF", 3) == 0 ){
+                offset = 3;
+            }
+            if( offset < m_size && m_data[offset] == '#' ){
+                const void* line_end = memchr(m_data + offset, '\n', m_size - offset);
+                offset = line_end ? size_t(static_cast<const char*>(line_end) - m_data) : m_size;
+                if( offset + 1 < m_size && m_data[offset + 1] == LUA_SIGNATURE[0] ){
+                    ++offset;
+                }
+            }
+            return offset;
+        }
+
+        const char* chunk() const{ return m_data + chunk_offset(); }
+        size_t chunk_size() const{ return m_size - chunk_offset(); }
+
+        /** @brief Compile the file as luaL_loadfile would, pushing the chunk or the error message. */
+        int load(lua_State* L, const char* chunk_name) const{
+            if( !valid() ){
+                lua_pushfstring(L, "cannot open %s", chunk_name[0] == '@' ? chunk_name + 1 : chunk_name);
+                return LUA_ERRFILE;
+            }
+            chunk_reader reader{ chunk(), chunk_size() };
+            return lua_load(L, chunk_reader::read, &reader, chunk_name, nullptr);
+        }
+    };
+}
+
+#endif
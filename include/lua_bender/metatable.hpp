@@ -22,15 +22,20 @@ namespace lua_bender{
     template<class C>
     struct lua_class_metatable : public lua_metatable{
         std::unordered_map<std::string, luaL_Reg> m_registry;
+        // When enabled scripts can add their own fields to each user data, stored in a registry table with weak keys.
+        bool m_dynamic_fields;
 
-        lua_class_metatable():  m_registry(){}
-        lua_class_metatable(int value_count, const luaL_Reg* reg): m_registry(){
+        // Only the address matters, used as registry key of the dynamic fields of the class.
+        static inline const char s_dynamic_fields_key = 0;
+
+        lua_class_metatable():  m_registry(), m_dynamic_fields(false){}
+        lua_class_metatable(int value_count, const luaL_Reg* reg, bool dynamic_fields = false): m_registry(), m_dynamic_fields(dynamic_fields){
             for(int i = 0; i < value_count; ++i){
                 set_function(reg[i].name, reg[i].func);
             }
         }
 
-        lua_class_metatable(const std::vector<luaL_Reg>& functions): m_registry(){
+        lua_class_metatable(const std::vector<luaL_Reg>& functions, bool dynamic_fields = false): m_registry(), m_dynamic_fields(dynamic_fields){
             for(const auto& reg : functions){
                 set_function(reg.name, reg.func);
             }
@@ -49,6 +54,11 @@ namespace lua_bender{
             int first_index = 1;
             user_data* udata = user_data::check(L, first_index);
             if( udata != nullptr ){
+                // User data owned by a smart pointer share their allocation with it.
+                if( udata->m_release != nullptr ){
+                    udata->m_release(lua_touserdata(L, first_index));
+                    return 0;
+                }
                 if( udata->m_garbage_collected && udata->m_data != nullptr ){
                     delete static_cast<C*>(udata->m_data);
                 }
@@ -92,11 +102,97 @@ namespace lua_bender{
             luaL_newmetatable(L, user_data_type_name<C>::s_name.c_str());
 
             luaL_setfuncs (L, regs.data(), 0);
-            lua_pushvalue(L, -1);
-            lua_setfield(L, -1, "__index");
+            if( m_dynamic_fields ){
+                // Both metamethods keep the metatable as upvalue to look up the native members first.
+                if( m_registry.count("__index") == 0 ){
+                    lua_pushvalue(L, -1);
+                    lua_pushcclosure(L, dynamic_index, 1);
+                    lua_setfield(L, -2, "__index");
+                }
+                if( m_registry.count("__newindex") == 0 ){
+                    lua_pushvalue(L, -1);
+                    lua_pushcclosure(L, dynamic_newindex, 1);
+                    lua_setfield(L, -2, "__newindex");
+                }
+            }
+            else if( m_registry.count("__index") == 0 ){
+                lua_pushvalue(L, -1);
+                lua_setfield(L, -1, "__index");
+            }
             lua_setglobal(L, user_data_type_name<C>::s_name.c_str());
         }
 
+        /**
+         * @brief Push the fields table of the user data at the given absolute index and return true, or return false and push nothing if it has none.
+         * The fields are keyed by the user data rather than the object address, so they are dropped with it and an object
+         * allocated later at the same address starts without fields.
+         */
+        static bool push_dynamic_fields(lua_State* L, int index, bool create){
+            if( lua_rawgetp(L, LUA_REGISTRYINDEX, &s_dynamic_fields_key) != LUA_TTABLE ){
+                lua_pop(L, 1);
+                if( !create ){
+                    return false;
+                }
+                lua_newtable(L);
+                lua_createtable(L, 0, 1);
+                lua_pushliteral(L, "k");
+                lua_setfield(L, -2, "__mode");
+                lua_setmetatable(L, -2);
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, LUA_REGISTRYINDEX, &s_dynamic_fields_key);
+            }
+            lua_pushvalue(L, index);
+            if( lua_rawget(L, -2) != LUA_TTABLE ){
+                lua_pop(L, 1);
+                if( !create ){
+                    lua_pop(L, 1);
+                    return false;
+                }
+                lua_createtable(L, 0, 4);
+                lua_pushvalue(L, index);
+                lua_pushvalue(L, -2);
+                lua_rawset(L, -4);
+            }
+            lua_remove(L, -2);
+            return true;
+        }
+
+        /** @brief __index looking up the native members then the fields of the object, upvalue 1 is the metatable. */
+        static int dynamic_index(lua_State* L){
+            lua_pushvalue(L, 2);
+            if( lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL ){
+                return 1;
+            }
+            lua_pop(L, 1);
+
+            user_data* udata = user_data::check(L, 1);
+            if( udata != nullptr && udata->m_data != nullptr && push_dynamic_fields(L, 1, false) ){
+                lua_pushvalue(L, 2);
+                lua_rawget(L, -2);
+                return 1;
+            }
+            lua_pushnil(L);
+            return 1;
+        }
+
+        /** @brief __newindex storing the field in the object table, allocated on the first write. */
+        static int dynamic_newindex(lua_State* L){
+            lua_pushvalue(L, 2);
+            if( lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL ){
+                return luaL_error(L, "cannot overwrite the native member %s of %s", luaL_tolstring(L, 2, nullptr), user_data_type_name<C>::s_name.c_str());
+            }
+            lua_pop(L, 1);
+
+            user_data* udata = user_data::check(L, 1);
+            if( udata == nullptr || udata->m_data == nullptr || !push_dynamic_fields(L, 1, true) ){
+                return luaL_error(L, "cannot set a field on an empty %s", user_data_type_name<C>::s_name.c_str());
+            }
+            lua_pushvalue(L, 2);
+            lua_pushvalue(L, 3);
+            lua_rawset(L, -3);
+            return 0;
+        }
+
         virtual const std::string& get_name() const{
             return lua_bender::user_data_type_name<C>::s_name;
         }
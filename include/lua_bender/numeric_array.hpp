@@ -0,0 +1,451 @@
+#ifndef LUA_BENDER_NUMERIC_ARRAY_HPP
+#define LUA_BENDER_NUMERIC_ARRAY_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "containers.hpp"
+#include "functions.hpp"
+#include "metatable.hpp"
+#include "user_data.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Typed numeric arrays store their elements contiguously in C++, so that hot numeric loops run natively
+// while scripts only orchestrate them.
+// The bulk operations use SSE2 or NEON kernels when available, define LUA_BENDER_NO_SIMD to only use the portable loops.
+//
+// lua_library lib({&lua_bender::float32_array::metatable()}, {});
+//
+// local a = float32_array.from({1, 2, 3})
+// local b = float32_array.new(3)
+// b:fill(2)
+// print(a:dot(b), #a, a[1])
+
+#ifndef LUA_BENDER_NO_SIMD
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define LUA_BENDER_SSE2
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define LUA_BENDER_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+namespace lua_bender{
+    // ******************************** KERNELS ********************************
+
+    /** @brief Portable kernels keeping four independent accumulators, which compilers can vectorize on their own. */
+    template<typename T>
+    struct portable_numeric_kernels{
+        // Integral elements are computed in unsigned arithmetic, wrapping around as the Lua integers instead of overflowing,
+        // and their sum and dot product are returned as lua_Integer.
+        typedef typename std::conditional<std::is_integral<T>::value, lua_Unsigned, T>::type accumulator;
+        typedef typename std::conditional<std::is_integral<T>::value, lua_Integer, T>::type result_type;
+
+        static result_type sum(const T* x, std::size_t n){
+            accumulator acc[4] = {accumulator(), accumulator(), accumulator(), accumulator()};
+            std::size_t i = 0;
+            for(; i + 4 <= n; i += 4){
+                acc[0] += accumulator(x[i]);     acc[1] += accumulator(x[i + 1]);
+                acc[2] += accumulator(x[i + 2]); acc[3] += accumulator(x[i + 3]);
+            }
+            for(; i < n; ++i){
+                acc[0] += accumulator(x[i]);
+            }
+            return result_type((acc[0] + acc[1]) + (acc[2] + acc[3]));
+        }
+
+        static result_type dot(const T* x, const T* y, std::size_t n){
+            accumulator acc[4] = {accumulator(), accumulator(), accumulator(), accumulator()};
+            std::size_t i = 0;
+            for(; i + 4 <= n; i += 4){
+                acc[0] += accumulator(x[i]) * accumulator(y[i]);         acc[1] += accumulator(x[i + 1]) * accumulator(y[i + 1]);
+                acc[2] += accumulator(x[i + 2]) * accumulator(y[i + 2]); acc[3] += accumulator(x[i + 3]) * accumulator(y[i + 3]);
+            }
+            for(; i < n; ++i){
+                acc[0] += accumulator(x[i]) * accumulator(y[i]);
+            }
+            return result_type((acc[0] + acc[1]) + (acc[2] + acc[3]));
+        }
+
+        /** @brief y = a * x + y */
+        static void axpy(T a, const T* x, T* y, std::size_t n){
+            for(std::size_t i = 0; i < n; ++i){
+                y[i] = T(accumulator(y[i]) + accumulator(a) * accumulator(x[i]));
+            }
+        }
+
+        static void scale(T a, T* x, std::size_t n){
+            for(std::size_t i = 0; i < n; ++i){
+                x[i] = T(accumulator(x[i]) * accumulator(a));
+            }
+        }
+
+        /** @brief Minimum of the n elements of x, and of the initial value. */
+        static T minimum(const T* x, std::size_t n, T res){
+            for(std::size_t i = 0; i < n; ++i){
+                res = x[i] < res ? x[i] : res;
+            }
+            return res;
+        }
+
+        /** @brief Maximum of the n elements of x, and of the initial value. */
+        static T maximum(const T* x, std::size_t n, T res){
+            for(std::size_t i = 0; i < n; ++i){
+                res = x[i] > res ? x[i] : res;
+            }
+            return res;
+        }
+    };
+
+    template<typename T>
+    struct numeric_kernels : portable_numeric_kernels<T>{};
+
+    // The vectorized kernels process the largest multiple of the register width and leave the tail to the portable ones.
+#if defined(LUA_BENDER_SSE2)
+    template<>
+    struct numeric_kernels<float> : portable_numeric_kernels<float>{
+        typedef portable_numeric_kernels<float> portable;
+
+        static float lanes_sum(__m128 v){
+            float lanes[4];
+            _mm_storeu_ps(lanes, v);
+            return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+
+        static float sum(const float* x, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            __m128 acc = _mm_setzero_ps();
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = _mm_add_ps(acc, _mm_loadu_ps(x + i));
+            }
+            return lanes_sum(acc) + portable::sum(x + simd_n, n - simd_n);
+        }
+
+        static float dot(const float* x, const float* y, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            __m128 acc = _mm_setzero_ps();
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+            }
+            return lanes_sum(acc) + portable::dot(x + simd_n, y + simd_n, n - simd_n);
+        }
+
+        static void axpy(float a, const float* x, float* y, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            __m128 va = _mm_set1_ps(a);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+            }
+            portable::axpy(a, x + simd_n, y + simd_n, n - simd_n);
+        }
+
+        static void scale(float a, float* x, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            __m128 va = _mm_set1_ps(a);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                _mm_storeu_ps(x + i, _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+            }
+            portable::scale(a, x + simd_n, n - simd_n);
+        }
+
+        static float minimum(const float* x, std::size_t n, float res){
+            std::size_t simd_n = n & ~std::size_t(3);
+            __m128 acc = _mm_set1_ps(res);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = _mm_min_ps(acc, _mm_loadu_ps(x + i));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            return portable::minimum(x + simd_n, n - simd_n, portable::minimum(lanes, 4, res));
+        }
+
+        static float maximum(const float* x, std::size_t n, float res){
+            std::size_t simd_n = n & ~std::size_t(3);
+            __m128 acc = _mm_set1_ps(res);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = _mm_max_ps(acc, _mm_loadu_ps(x + i));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            return portable::maximum(x + simd_n, n - simd_n, portable::maximum(lanes, 4, res));
+        }
+    };
+
+    template<>
+    struct numeric_kernels<double> : portable_numeric_kernels<double>{
+        typedef portable_numeric_kernels<double> portable;
+
+        static double lanes_sum(__m128d v){
+            double lanes[2];
+            _mm_storeu_pd(lanes, v);
+            return lanes[0] + lanes[1];
+        }
+
+        static double sum(const double* x, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(1);
+            __m128d acc = _mm_setzero_pd();
+            for(std::size_t i = 0; i < simd_n; i += 2){
+                acc = _mm_add_pd(acc, _mm_loadu_pd(x + i));
+            }
+            return lanes_sum(acc) + portable::sum(x + simd_n, n - simd_n);
+        }
+
+        static double dot(const double* x, const double* y, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(1);
+            __m128d acc = _mm_setzero_pd();
+            for(std::size_t i = 0; i < simd_n; i += 2){
+                acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+            }
+            return lanes_sum(acc) + portable::dot(x + simd_n, y + simd_n, n - simd_n);
+        }
+
+        static void axpy(double a, const double* x, double* y, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(1);
+            __m128d va = _mm_set1_pd(a);
+            for(std::size_t i = 0; i < simd_n; i += 2){
+                _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+            }
+            portable::axpy(a, x + simd_n, y + simd_n, n - simd_n);
+        }
+
+        static void scale(double a, double* x, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(1);
+            __m128d va = _mm_set1_pd(a);
+            for(std::size_t i = 0; i < simd_n; i += 2){
+                _mm_storeu_pd(x + i, _mm_mul_pd(va, _mm_loadu_pd(x + i)));
+            }
+            portable::scale(a, x + simd_n, n - simd_n);
+        }
+
+        static double minimum(const double* x, std::size_t n, double res){
+            std::size_t simd_n = n & ~std::size_t(1);
+            __m128d acc = _mm_set1_pd(res);
+            for(std::size_t i = 0; i < simd_n; i += 2){
+                acc = _mm_min_pd(acc, _mm_loadu_pd(x + i));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, acc);
+            return portable::minimum(x + simd_n, n - simd_n, portable::minimum(lanes, 2, res));
+        }
+
+        static double maximum(const double* x, std::size_t n, double res){
+            std::size_t simd_n = n & ~std::size_t(1);
+            __m128d acc = _mm_set1_pd(res);
+            for(std::size_t i = 0; i < simd_n; i += 2){
+                acc = _mm_max_pd(acc, _mm_loadu_pd(x + i));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, acc);
+            return portable::maximum(x + simd_n, n - simd_n, portable::maximum(lanes, 2, res));
+        }
+    };
+#elif defined(LUA_BENDER_NEON)
+    template<>
+    struct numeric_kernels<float> : portable_numeric_kernels<float>{
+        typedef portable_numeric_kernels<float> portable;
+
+        static float lanes_sum(float32x4_t v){
+            return (vgetq_lane_f32(v, 0) + vgetq_lane_f32(v, 1)) + (vgetq_lane_f32(v, 2) + vgetq_lane_f32(v, 3));
+        }
+
+        static float sum(const float* x, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            float32x4_t acc = vdupq_n_f32(0.0f);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = vaddq_f32(acc, vld1q_f32(x + i));
+            }
+            return lanes_sum(acc) + portable::sum(x + simd_n, n - simd_n);
+        }
+
+        static float dot(const float* x, const float* y, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            float32x4_t acc = vdupq_n_f32(0.0f);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = vmlaq_f32(acc, vld1q_f32(x + i), vld1q_f32(y + i));
+            }
+            return lanes_sum(acc) + portable::dot(x + simd_n, y + simd_n, n - simd_n);
+        }
+
+        static void axpy(float a, const float* x, float* y, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                vst1q_f32(y + i, vmlaq_n_f32(vld1q_f32(y + i), vld1q_f32(x + i), a));
+            }
+            portable::axpy(a, x + simd_n, y + simd_n, n - simd_n);
+        }
+
+        static void scale(float a, float* x, std::size_t n){
+            std::size_t simd_n = n & ~std::size_t(3);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                vst1q_f32(x + i, vmulq_n_f32(vld1q_f32(x + i), a));
+            }
+            portable::scale(a, x + simd_n, n - simd_n);
+        }
+
+        static float minimum(const float* x, std::size_t n, float res){
+            std::size_t simd_n = n & ~std::size_t(3);
+            float32x4_t acc = vdupq_n_f32(res);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = vminq_f32(acc, vld1q_f32(x + i));
+            }
+            float lanes[4];
+            vst1q_f32(lanes, acc);
+            return portable::minimum(x + simd_n, n - simd_n, portable::minimum(lanes, 4, res));
+        }
+
+        static float maximum(const float* x, std::size_t n, float res){
+            std::size_t simd_n = n & ~std::size_t(3);
+            float32x4_t acc = vdupq_n_f32(res);
+            for(std::size_t i = 0; i < simd_n; i += 4){
+                acc = vmaxq_f32(acc, vld1q_f32(x + i));
+            }
+            float lanes[4];
+            vst1q_f32(lanes, acc);
+            return portable::maximum(x + simd_n, n - simd_n, portable::maximum(lanes, 4, res));
+        }
+    };
+#endif
+
+
+    // ******************************** ARRAYS ********************************
+
+    template<typename T>
+    struct numeric_array{
+        std::vector<T> m_values;
+
+        numeric_array(): m_values(){}
+        numeric_array(int size): m_values(std::size_t(size > 0 ? size : 0)){}
+        numeric_array(const std::vector<T>& values): m_values(values){}
+
+        int size() const{ return int(m_values.size()); }
+        T* data(){ return m_values.data(); }
+        const T* data() const{ return m_values.data(); }
+
+        void resize(int size){ m_values.resize(std::size_t(size > 0 ? size : 0)); }
+        void fill(T value){ std::fill(m_values.begin(), m_values.end(), value); }
+        std::vector<T> to_table() const{ return m_values; }
+
+        typedef typename numeric_kernels<T>::result_type result_type;
+
+        result_type sum() const{ return numeric_kernels<T>::sum(data(), m_values.size()); }
+        T minimum() const{ return m_values.empty() ? T() : numeric_kernels<T>::minimum(data(), m_values.size(), m_values[0]); }
+        T maximum() const{ return m_values.empty() ? T() : numeric_kernels<T>::maximum(data(), m_values.size(), m_values[0]); }
+        void scale(T factor){ numeric_kernels<T>::scale(factor, data(), m_values.size()); }
+        void sort(){ std::sort(m_values.begin(), m_values.end()); }
+
+        /** @brief Dot product over the common length of both arrays. */
+        result_type dot(const numeric_array& other) const{
+            return numeric_kernels<T>::dot(data(), other.data(), (std::min)(m_values.size(), other.m_values.size()));
+        }
+
+        /** @brief this = factor * other + this, over the common length of both arrays. */
+        void axpy(T factor, const numeric_array& other){
+            numeric_kernels<T>::axpy(factor, other.data(), data(), (std::min)(m_values.size(), other.m_values.size()));
+        }
+
+        /** @brief Return the array at the given index, or null if the value is not such an array. */
+        static numeric_array* test(lua_State* L, int index){
+            user_data** block = static_cast<user_data**>(luaL_testudata(L, index, user_data_type_name<numeric_array>::s_name.c_str()));
+            return block != nullptr && *block != nullptr ? static_cast<numeric_array*>((*block)->m_data) : nullptr;
+        }
+
+        /** @brief Return the array at the given index, raising an argument error if it is not an array of the same type. */
+        static numeric_array& check(lua_State* L, int index){
+            numeric_array* res = test(L, index);
+            if( res == nullptr ){
+                const char* message = lua_pushfstring(L, "%s expected, got %s", user_data_type_name<numeric_array>::s_name.c_str(), luaL_typename(L, index));
+                luaL_argerror(L, index, message);
+            }
+            return *res;
+        }
+
+        static int dot_adapter(lua_State* L){
+            numeric_array& self = check(L, 1);
+            sequence_element<T>::push(L, self.dot(check(L, 2)));
+            return 1;
+        }
+
+        static int axpy_adapter(lua_State* L){
+            numeric_array& self = check(L, 1);
+            T factor = sequence_element<T>::check_at(L, 2);
+            self.axpy(factor, check(L, 3));
+            return 0;
+        }
+
+        /** @brief __index reading the elements from 1 to #array, and the bound functions for other keys. */
+        static int index(lua_State* L){
+            user_data* udata = user_data::check(L, 1);
+            int is_integer = 0;
+            lua_Integer i = lua_type(L, 2) == LUA_TNUMBER ? lua_tointegerx(L, 2, &is_integer) : 0;
+            if( is_integer ){
+                numeric_array* self = udata != nullptr ? static_cast<numeric_array*>(udata->m_data) : nullptr;
+                if( self != nullptr && i >= 1 && i <= lua_Integer(self->m_values.size()) ){
+                    sequence_element<T>::push(L, self->m_values[std::size_t(i - 1)]);
+                }
+                else{
+                    lua_pushnil(L);
+                }
+                return 1;
+            }
+
+            lua_getmetatable(L, 1);
+            lua_pushvalue(L, 2);
+            lua_rawget(L, -2);
+            return 1;
+        }
+
+        static int newindex(lua_State* L){
+            user_data* udata = user_data::check(L, 1);
+            numeric_array* self = udata != nullptr ? static_cast<numeric_array*>(udata->m_data) : nullptr;
+            lua_Integer i = luaL_checkinteger(L, 2);
+            luaL_argcheck(L, self != nullptr && i >= 1 && i <= lua_Integer(self->m_values.size()), 2, "index out of range");
+            self->m_values[std::size_t(i - 1)] = sequence_element<T>::check_at(L, 3);
+            return 0;
+        }
+
+        static int len(lua_State* L){
+            user_data* udata = user_data::check(L, 1);
+            numeric_array* self = udata != nullptr ? static_cast<numeric_array*>(udata->m_data) : nullptr;
+            lua_pushinteger(L, self != nullptr ? lua_Integer(self->m_values.size()) : 0);
+            return 1;
+        }
+
+        /** @brief Metatable binding the array type, shared by all the states. */
+        static lua_class_metatable<numeric_array>& metatable(){
+            typedef lua_class_metatable<numeric_array> metatable_type;
+            static metatable_type s_metatable({
+                {"new",        metatable_type::template create_instance<int>},
+                {"from",       metatable_type::template create_instance<std::vector<T>>},
+                {"__gc",       metatable_type::destroy_instance},
+                {"__index",    index},
+                {"__newindex", newindex},
+                {"__len",      len},
+                {"resize",     lua_bender_member_function(numeric_array::resize)},
+                {"fill",       lua_bender_member_function(numeric_array::fill)},
+                {"to_table",   lua_bender_member_function(numeric_array::to_table)},
+                {"sum",        lua_bender_member_function(numeric_array::sum)},
+                {"min",        lua_bender_member_function(numeric_array::minimum)},
+                {"max",        lua_bender_member_function(numeric_array::maximum)},
+                {"scale",      lua_bender_member_function(numeric_array::scale)},
+                {"sort",       lua_bender_member_function(numeric_array::sort)},
+                // The other array is checked against the type of this one.
+                {"dot",        dot_adapter},
+                {"axpy",       axpy_adapter}
+            });
+            return s_metatable;
+        }
+    };
+
+    typedef numeric_array<float>        float32_array;
+    typedef numeric_array<double>       float64_array;
+    typedef numeric_array<std::int32_t> int32_array;
+
+    template<> inline std::string user_data_type_name<float32_array>::s_name = "float32_array";
+    template<> inline std::string user_data_type_name<float64_array>::s_name = "float64_array";
+    template<> inline std::string user_data_type_name<int32_array>::s_name   = "int32_array";
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef LUA_BENDER_OPTIONAL_HPP
+#define LUA_BENDER_OPTIONAL_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "containers.hpp"
+#include <array>
+#include <optional>
+#include <variant>
+
+
+// This file extends the value template to std::optional and std::variant.
+// An empty optional is exchanged as nil, so functions returning "nothing or a value" keep a plain C++ signature:
+//
+// std::optional<std::string> find_name(int id);
+//
+// A variant is pushed with std::visit, and read by dispatching on lua_type through a jump table built at compile time:
+// each Lua type selects the first alternative accepting it, a number favors an integral alternative when it is an integer,
+// and several user data alternatives are told apart by their metatable.
+
+namespace lua_bender{
+    template<typename T>
+    struct value<const std::optional<T>&>{
+        static std::optional<T> check(lua_State* L, int index){
+            if( lua_isnoneornil(L, index) ){
+                return std::nullopt;
+            }
+            return std::optional<T>(sequence_element<T>::check_at(L, index));
+        }
+
+        static int push(lua_State* L, const std::optional<T>& value){
+            if( !value ){
+                lua_pushnil(L);
+                return 1;
+            }
+            sequence_element<T>::push(L, *value);
+            return 1;
+        }
+    };
+
+    /** @brief std::monostate is the nil alternative of a variant. */
+    template<>
+    struct value<const std::monostate&>{
+        static std::monostate check(lua_State*, int){ return std::monostate(); }
+
+        static int push(lua_State* L, std::monostate){
+            lua_pushnil(L);
+            return 1;
+        }
+    };
+
+
+    // ******************************** VARIANT ********************************
+
+    /** @brief Lua type a C++ type is exchanged as, the remaining classes being user data. */
+    template<typename T>
+    struct lua_type_of{
+        static constexpr bool s_number = std::is_arithmetic<T>::value || std::is_enum<T>::value;
+        static constexpr int  s_type = s_number ? LUA_TNUMBER : (struct_fields<T>::s_registered ? LUA_TTABLE : (std::is_class<T>::value ? LUA_TUSERDATA : LUA_TNONE));
+        static constexpr bool s_integral = std::is_integral<T>::value || std::is_enum<T>::value;
+        typedef T class_type;
+    };
+
+    template<> struct lua_type_of<bool>            { static constexpr int s_type = LUA_TBOOLEAN; static constexpr bool s_integral = false; };
+    template<> struct lua_type_of<std::monostate>  { static constexpr int s_type = LUA_TNIL;     static constexpr bool s_integral = false; };
+    template<> struct lua_type_of<std::string>     { static constexpr int s_type = LUA_TSTRING;  static constexpr bool s_integral = false; };
+    template<> struct lua_type_of<const char*>     { static constexpr int s_type = LUA_TSTRING;  static constexpr bool s_integral = false; };
+
+    template<typename T> struct lua_type_of<std::vector<T>>                   { static constexpr int s_type = LUA_TTABLE; static constexpr bool s_integral = false; };
+    template<typename T> struct lua_type_of<std::deque<T>>                    { static constexpr int s_type = LUA_TTABLE; static constexpr bool s_integral = false; };
+    template<typename T, std::size_t N> struct lua_type_of<std::array<T, N>>  { static constexpr int s_type = LUA_TTABLE; static constexpr bool s_integral = false; };
+    template<typename K, typename V> struct lua_type_of<std::map<K, V>>           { static constexpr int s_type = LUA_TTABLE; static constexpr bool s_integral = false; };
+    template<typename K, typename V> struct lua_type_of<std::unordered_map<K, V>> { static constexpr int s_type = LUA_TTABLE; static constexpr bool s_integral = false; };
+
+    template<typename C> struct lua_type_of<C*>                 : lua_type_of<C>{};
+    template<typename C> struct lua_type_of<std::shared_ptr<C>> : lua_type_of<C>{};
+    template<typename C> struct lua_type_of<std::unique_ptr<C>> : lua_type_of<C>{};
+
+
+    template<typename ...Ts>
+    struct value<const std::variant<Ts...>&>{
+        typedef std::variant<Ts...> variant_type;
+        typedef variant_type (*reader_type)(lua_State* L, int index);
+
+        static constexpr std::size_t s_count = sizeof...(Ts);
+        static constexpr std::array<int, sizeof...(Ts)>  s_types = {{ lua_type_of<Ts>::s_type... }};
+        static constexpr std::array<bool, sizeof...(Ts)> s_integrals = {{ lua_type_of<Ts>::s_integral... }};
+
+        /** @brief Index of the first alternative matching the given Lua type and integral flag, s_count if none. */
+        static constexpr std::size_t find_alternative(int type, int integral){
+            for(std::size_t i = 0; i < s_count; ++i){
+                if( s_types[i] == type && (integral < 0 || s_integrals[i] == bool(integral)) ){
+                    return i;
+                }
+            }
+            return s_count;
+        }
+
+        static constexpr std::size_t count_alternatives(int type){
+            std::size_t count = 0;
+            for(std::size_t i = 0; i < s_count; ++i){
+                count += s_types[i] == type ? 1 : 0;
+            }
+            return count;
+        }
+
+        template<std::size_t I>
+        static variant_type read_alternative(lua_State* L, int index){
+            return variant_type(std::in_place_index<I>, sequence_element< std::variant_alternative_t<I, variant_type> >::check_at(L, index));
+        }
+
+        static variant_type read_none(lua_State* L, int index){
+            luaL_error(L, "no variant alternative accepts a %s value", luaL_typename(L, index));
+            return variant_type();
+        }
+
+        /** @brief Integers go to the first integral alternative and the other numbers to the first floating one. */
+        static variant_type read_number(lua_State* L, int index){
+            constexpr std::size_t integral = find_alternative(LUA_TNUMBER, 1);
+            constexpr std::size_t floating = find_alternative(LUA_TNUMBER, 0);
+            return s_readers[lua_isinteger(L, index) ? integral : floating](L, index);
+        }
+
+        /** @brief The first user data alternative whose metatable matches the value is selected. */
+        static variant_type read_user_data(lua_State* L, int index){
+            std::size_t selected = s_count;
+            std::size_t i = 0;
+            ((selected = selected == s_count && s_types[i] == LUA_TUSERDATA && test_user_data<Ts>(L, index) ? i : selected, ++i), ...);
+            return s_readers[selected](L, index);
+        }
+
+        template<typename T>
+        static bool test_user_data(lua_State* L, int index){
+            if constexpr( lua_type_of<T>::s_type == LUA_TUSERDATA ){
+                return luaL_testudata(L, index, user_data_type_name<typename lua_type_of<T>::class_type>::s_name.c_str()) != nullptr;
+            }
+            else{
+                return false;
+            }
+        }
+
+        template<std::size_t ...Is>
+        static constexpr std::array<reader_type, sizeof...(Ts) + 1> make_readers(std::index_sequence<Is...>){
+            return {{ &read_alternative<Is>..., &read_none }};
+        }
+
+        static constexpr std::array<reader_type, sizeof...(Ts) + 1> s_readers = make_readers(std::index_sequence_for<Ts...>());
+
+        /** @brief Reader selected for the given Lua type, the ambiguous numbers and user data being solved at run time. */
+        static constexpr reader_type select_reader(int type){
+            if( type == LUA_TNUMBER && find_alternative(type, 1) != s_count && find_alternative(type, 0) != s_count ){
+                return &read_number;
+            }
+            if( type == LUA_TUSERDATA && count_alternatives(type) > 1 ){
+                return &read_user_data;
+            }
+            // A missing value is read as nil, so that a trailing variant argument can be omitted.
+            return s_readers[find_alternative(type == LUA_TNONE ? LUA_TNIL : type, -1)];
+        }
+
+        template<std::size_t ...Types>
+        static constexpr std::array<reader_type, sizeof...(Types)> make_jump_table(std::index_sequence<Types...>){
+            return {{ select_reader(int(Types) - 1)... }};
+        }
+
+        // Indexed by lua_type + 1, covering LUA_TNONE to the last basic type.
+        static constexpr std::array<reader_type, LUA_NUMTAGS + 1> s_jump_table = make_jump_table(std::make_index_sequence<LUA_NUMTAGS + 1>());
+
+        static variant_type check(lua_State* L, int index){
+            return s_jump_table[std::size_t(lua_type(L, index) + 1)](L, index);
+        }
+
+        static int push(lua_State* L, const variant_type& value){
+            std::visit([L](const auto& alternative){
+                sequence_element< typename std::decay<decltype(alternative)>::type >::push(L, alternative);
+            }, value);
+            return 1;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef LUA_BENDER_REF_HPP
+#define LUA_BENDER_REF_HPP
+#pragma once
+
+#include "basis.hpp"
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+// lua_ref keeps a Lua value alive in the registry so that it can be pushed back later, e.g. to decode a result only if needed.
+// The released registry slots are kept in a small per-state cache and reused directly by the next references,
+// instead of going through the luaL_ref free list each time.
+//
+// A lua_ref must be destroyed, or released, before its state is closed.
+
+namespace lua_bender{
+    /**
+     * @brief Per-state instance of T, default constructed on first use in a user data of the registry.
+     * The instance is destroyed by a __gc metamethod when the state is closed, unless T is trivially destructible.
+     */
+    template<class T>
+    struct registry_singleton{
+        // Only the address matters, used as registry key of the instance.
+        static inline const char s_registry_key = 0;
+
+        static int destroy(lua_State* L){
+            static_cast<T*>(lua_touserdata(L, 1))->~T();
+            return 0;
+        }
+
+        /** @brief Return the instance of the given state, created on first use. */
+        static T& get(lua_State* L){
+            T* instance;
+            if( lua_rawgetp(L, LUA_REGISTRYINDEX, &s_registry_key) == LUA_TUSERDATA ){
+                instance = static_cast<T*>(lua_touserdata(L, -1));
+            }
+            else{
+                lua_pop(L, 1);
+                instance = new (lua_newuserdata(L, sizeof(T))) T();
+                if constexpr( !std::is_trivially_destructible<T>::value ){
+                    lua_createtable(L, 0, 1);
+                    lua_pushcfunction(L, destroy);
+                    lua_setfield(L, -2, "__gc");
+                    lua_setmetatable(L, -2);
+                }
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, LUA_REGISTRYINDEX, &s_registry_key);
+            }
+            lua_pop(L, 1);
+            return *instance;
+        }
+    };
+
+
+    /** @brief Free registry slots of a state, stored in a user data of its registry. */
+    struct lua_ref_cache{
+        static constexpr int s_capacity = 64;
+
+        int m_count;
+        int m_slots[s_capacity];
+
+        lua_ref_cache(): m_count(){}
+
+        /** @brief Return the cache of the given state, created on first use. */
+        static lua_ref_cache& get(lua_State* L){
+            return registry_singleton<lua_ref_cache>::get(L);
+        }
+
+        /** @brief Pop the value on top of the stack into a registry slot, LUA_REFNIL for nil as luaL_ref. */
+        static int acquire(lua_State* L){
+            if( lua_isnil(L, -1) ){
+                lua_pop(L, 1);
+                return LUA_REFNIL;
+            }
+            lua_ref_cache& cache = get(L);
+            if( cache.m_count == 0 ){
+                return luaL_ref(L, LUA_REGISTRYINDEX);
+            }
+            int slot = cache.m_slots[--cache.m_count];
+            lua_rawseti(L, LUA_REGISTRYINDEX, slot);
+            return slot;
+        }
+
+        /** @brief Release the value of a slot, which stays reserved with false while it is cached. */
+        static void release(lua_State* L, int slot){
+            if( slot < 0 ){
+                return;
+            }
+            lua_ref_cache& cache = get(L);
+            if( cache.m_count == s_capacity ){
+                luaL_unref(L, LUA_REGISTRYINDEX, slot);
+                return;
+            }
+            lua_pushboolean(L, 0);
+            lua_rawseti(L, LUA_REGISTRYINDEX, slot);
+            cache.m_slots[cache.m_count++] = slot;
+        }
+    };
+
+
+    /** @brief RAII registry reference, movable but not copyable. */
+    struct lua_ref{
+        // Main thread of the state, which stays valid as long as the state whereas a coroutine may be collected.
+        lua_State* m_state;
+        int        m_ref;
+
+        lua_ref(): m_state(), m_ref(LUA_NOREF){}
+
+        /** @brief Reference the value at the given index. */
+        lua_ref(lua_State* L, int index): m_state(main_thread(L)), m_ref(LUA_NOREF){
+            lua_pushvalue(L, index);
+            m_ref = lua_ref_cache::acquire(L);
+        }
+
+        lua_ref(const lua_ref&) = delete;
+        lua_ref& operator=(const lua_ref&) = delete;
+
+        lua_ref(lua_ref&& other) noexcept: m_state(other.m_state), m_ref(other.m_ref){
+            other.m_state = nullptr;
+            other.m_ref = LUA_NOREF;
+        }
+
+        lua_ref& operator=(lua_ref&& other) noexcept{
+            if( this != &other ){
+                release();
+                std::swap(m_state, other.m_state);
+                std::swap(m_ref, other.m_ref);
+            }
+            return *this;
+        }
+
+        ~lua_ref(){ release(); }
+
+        /** @brief Reference the value on top of the stack and pop it. */
+        static lua_ref pop(lua_State* L){
+            lua_ref res;
+            res.m_state = main_thread(L);
+            res.m_ref = lua_ref_cache::acquire(L);
+            return res;
+        }
+
+        static lua_State* main_thread(lua_State* L){
+            lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+            lua_State* res = lua_tothread(L, -1);
+            lua_pop(L, 1);
+            return res;
+        }
+
+        bool valid() const{ return m_state != nullptr && m_ref != LUA_NOREF; }
+
+        void release(){
+            if( m_state != nullptr ){
+                lua_ref_cache::release(m_state, m_ref);
+            }
+            m_state = nullptr;
+            m_ref = LUA_NOREF;
+        }
+
+        /** @brief Push the referenced value on the given thread of the state, nil for an empty reference, and return its type. */
+        int push(lua_State* L) const{
+            if( m_ref < 0 ){
+                lua_pushnil(L);
+                return LUA_TNIL;
+            }
+            return lua_rawgeti(L, LUA_REGISTRYINDEX, m_ref);
+        }
+
+        int push() const{ return push(m_state); }
+    };
+
+
+    template<>
+    struct value<const lua_ref&>{
+        static lua_ref check(lua_State* L, int index){ return lua_ref(L, index); }
+
+        static int push(lua_State* L, const lua_ref& value){
+            value.push(L);
+            return 1;
+        }
+    };
+}
+
+#endif
@@ -3,26 +3,351 @@
 #pragma once
 
 #include "basis.hpp"
+#include "mapped_file.hpp"
+#include "ref.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+
+// Scripts are compiled only once: compiled_script keeps a loaded chunk in the registry and runs it again on demand,
+// and do_string / do_file go through a per-state LRU cache of chunks keyed by the hash of their source.
+//
+// lua_bender::compiled_script update = lua_bender::compiled_script::load(L, "update()");
+// update.run(L, 0);
 
 namespace lua_bender{
+    /** @brief 64 bits FNV-1a hash, seeded with a previous hash to chain several blocks. */
+    inline std::uint64_t fnv1a_hash(const void* data, size_t size, std::uint64_t hash = 14695981039346656037ull){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for(size_t i = 0; i < size; ++i){
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /** @brief Call the chunk on top of the stack, leaving its results; print and pop the error on failure. */
+    inline bool run_chunk(lua_State* L, int results = LUA_MULTRET){
+        if( lua_pcall(L, 0, results, 0) != LUA_OK ){
+            printf("Error: %s \n", lua_tostring(L, -1));
+            lua_pop(L, 1);
+            return false;
+        }
+        return true;
+    }
+
+
+    /** @brief Chunk loaded once and kept alive in the registry, to be run any number of times without parsing it again. */
+    struct compiled_script{
+        lua_ref m_chunk;
+
+        /** @brief Compile the code, chunk_name being used by the error messages; print the error and return an invalid script on failure. */
+        static compiled_script load(lua_State* L, const char* code, size_t size, const char* chunk_name){
+            compiled_script res;
+            if( luaL_loadbuffer(L, code, size, chunk_name) != LUA_OK ){
+                printf("Error: %s \n", lua_tostring(L, -1));
+                lua_pop(L, 1);
+                return res;
+            }
+            res.m_chunk = lua_ref::pop(L);
+            return res;
+        }
+
+        static compiled_script load(lua_State* L, const char* code){
+            return load(L, code, strlen(code), code);
+        }
+
+        static compiled_script load_file(lua_State* L, const char* file){
+            compiled_script res;
+            std::string chunk_name = std::string("@") + file;
+            if( mapped_file(file).load(L, chunk_name.c_str()) != LUA_OK ){
+                printf("Error: %s \n", lua_tostring(L, -1));
+                lua_pop(L, 1);
+                return res;
+            }
+            res.m_chunk = lua_ref::pop(L);
+            return res;
+        }
+
+        bool valid() const{ return m_chunk.valid(); }
+
+        /** @brief Run the chunk on the given thread, leaving the requested number of results on the stack. */
+        bool run(lua_State* L, int results = LUA_MULTRET) const{
+            if( !valid() ){
+                return false;
+            }
+            m_chunk.push(L);
+            return run_chunk(L, results);
+        }
+    };
+
+
+    /**
+     * @brief Compiled chunks dumped to a directory, so that the next processes skip the compilation of the same scripts.
+     * The files are named after the hash of the source, the chunk name and the Lua release, and their header is checked
+     * against the source before loading them, a second hash of the source telling the collisions of the file names apart.
+     * Lua does not verify the bytecode it loads, the directory must only be writable by trusted processes.
+     */
+    struct bytecode_cache{
+        // Seed of the second hash of the source, stored in the header.
+        static constexpr std::uint64_t s_check_seed = 0x9E3779B97F4A7C15ull;
+
+        struct header{
+            char          m_magic[4];
+            std::uint32_t m_version;
+            std::uint64_t m_key;
+            std::uint64_t m_check;
+            std::uint64_t m_source_size;
+        };
+
+        static header make_header(std::uint64_t key, std::uint64_t check, size_t source_size){
+            return header{ { 'L', 'B', 'B', '2' }, std::uint32_t(LUA_VERSION_NUM), key, check, std::uint64_t(source_size) };
+        }
+
+        static std::uint64_t check(const char* code, size_t size){
+            return fnv1a_hash(code, size, s_check_seed);
+        }
+
+        static std::uint64_t key(const char* code, size_t size, const char* chunk_name){
+            std::uint64_t hash = fnv1a_hash(code, size);
+            hash = fnv1a_hash(chunk_name, strlen(chunk_name), hash);
+            return fnv1a_hash(LUA_RELEASE, sizeof(LUA_RELEASE) - 1, hash);
+        }
+
+        static std::string path(const std::string& directory, std::uint64_t key){
+            char name[32];
+            snprintf(name, sizeof(name), "/%016llx.luac", static_cast<unsigned long long>(key));
+            return directory + name;
+        }
+
+        /** @brief Push the chunk dumped in the file, return false and push nothing if it is missing, stale or corrupted. */
+        static bool load(lua_State* L, const std::string& file, std::uint64_t key, std::uint64_t check, size_t source_size, const char* chunk_name){
+            mapped_file dump(file.c_str());
+            if( !dump.valid() || dump.m_size < sizeof(header) ){
+                return false;
+            }
+            header expected = make_header(key, check, source_size);
+            if( memcmp(dump.m_data, &expected, sizeof(header)) != 0 ){
+                return false;
+            }
+            if( luaL_loadbufferx(L, dump.m_data + sizeof(header), dump.m_size - sizeof(header), chunk_name, "b") != LUA_OK ){
+                lua_pop(L, 1);
+                return false;
+            }
+            return true;
+        }
+
+        static int write(lua_State*, const void* data, size_t size, void* content){
+            static_cast<std::string*>(content)->append(static_cast<const char*>(data), size);
+            return 0;
+        }
+
+        /** @brief Name of a temporary file next to the given one, unique to the process and to the call. */
+        static std::string temporary_path(const std::string& file){
+            static std::atomic<unsigned> s_counter(0);
+#ifdef _WIN32
+            unsigned long process = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+            unsigned long process = static_cast<unsigned long>(getpid());
+#endif
+            char suffix[48];
+            snprintf(suffix, sizeof(suffix), ".%lu.%u.tmp", process, s_counter++);
+            return file + suffix;
+        }
+
+        /**
+         * @brief Dump the chunk on top of the stack, through a temporary file so that no reader sees a partial dump.
+         * The temporary file is unique, several processes or states storing the same chunk at once do not write to the same file.
+         */
+        static bool store(lua_State* L, const std::string& file, std::uint64_t key, std::uint64_t check, size_t source_size){
+            header file_header = make_header(key, check, source_size);
+            std::string content(reinterpret_cast<const char*>(&file_header), sizeof(header));
+            if( lua_dump(L, write, &content, 0) != 0 ){
+                return false;
+            }
+            std::string temporary = temporary_path(file);
+            FILE* stream = fopen(temporary.c_str(), "wb");
+            if( stream == nullptr ){
+                return false;
+            }
+            bool res = fwrite(content.data(), 1, content.size(), stream) == content.size();
+            res = fclose(stream) == 0 && res;
+            if( res && rename(temporary.c_str(), file.c_str()) != 0 ){
+                // rename does not replace an existing file on every platform.
+                remove(file.c_str());
+                res = rename(temporary.c_str(), file.c_str()) == 0;
+            }
+            if( !res ){
+                remove(temporary.c_str());
+            }
+            return res;
+        }
+    };
+
+
+    /** @brief Per-state LRU cache of compiled chunks, stored in a user data of the registry. */
+    struct script_cache{
+        static constexpr size_t s_default_capacity = 32;
+
+        // do_string names the chunk after its code, whose copy then stands for both.
+        struct entry{
+            std::uint64_t m_hash;
+            std::string   m_source;
+            std::string   m_chunk_name;
+            bool          m_named_after_source;
+            int           m_ref;
+
+            /** @brief Exact comparison of the source and of the chunk name, telling hash collisions apart. */
+            bool matches(const char* code, size_t size, const char* chunk_name) const{
+                if( m_source.size() != size || memcmp(m_source.data(), code, size) != 0 ){
+                    return false;
+                }
+                return (m_named_after_source ? m_source : m_chunk_name) == chunk_name;
+            }
+        };
+
+        // Most recently used first.
+        std::list<entry>                                              m_entries;
+        std::unordered_map<std::uint64_t, std::list<entry>::iterator> m_index;
+        size_t                                                        m_capacity;
+        size_t                                                        m_hits;
+        size_t                                                        m_misses;
+        // Optional bytecode_cache directory, used on misses when not empty.
+        std::string                                                   m_bytecode_directory;
+        size_t                                                        m_bytecode_hits;
+
+        script_cache(): m_capacity(s_default_capacity), m_hits(), m_misses(), m_bytecode_hits(){}
+
+        /**
+         * @brief Return the cache of the given state, created on first use.
+         * The registry slots are not released, the cache is only collected when the state is closed.
+         */
+        static script_cache& get(lua_State* L){
+            return registry_singleton<script_cache>::get(L);
+        }
+
+        /** @brief Enable the bytecode_cache in an existing directory, or disable it with an empty path. */
+        void set_bytecode_directory(const char* directory){
+            m_bytecode_directory = directory;
+        }
+
+        void set_capacity(lua_State* L, size_t capacity){
+            m_capacity = capacity;
+            while( m_entries.size() > m_capacity ){
+                evict(L);
+            }
+        }
+
+        void evict(lua_State* L){
+            const entry& oldest = m_entries.back();
+            lua_ref_cache::release(L, oldest.m_ref);
+            m_index.erase(oldest.m_hash);
+            m_entries.pop_back();
+        }
+
+        void clear(lua_State* L){
+            while( !m_entries.empty() ){
+                evict(L);
+            }
+        }
+
+        /** @brief Push the chunk from the bytecode_cache if enabled and up to date, or compile it from the source and dump it. */
+        bool load(lua_State* L, const char* code, size_t size, const char* chunk_name){
+            std::uint64_t key = 0;
+            std::uint64_t check = 0;
+            std::string file;
+            if( !m_bytecode_directory.empty() ){
+                key = bytecode_cache::key(code, size, chunk_name);
+                check = bytecode_cache::check(code, size);
+                file = bytecode_cache::path(m_bytecode_directory, key);
+                if( bytecode_cache::load(L, file, key, check, size, chunk_name) ){
+                    ++m_bytecode_hits;
+                    return true;
+                }
+            }
+            if( luaL_loadbuffer(L, code, size, chunk_name) != LUA_OK ){
+                printf("Error: %s \n", lua_tostring(L, -1));
+                lua_pop(L, 1);
+                return false;
+            }
+            if( !file.empty() ){
+                bytecode_cache::store(L, file, key, check, size);
+            }
+            return true;
+        }
+
+        /** @brief Push the compiled chunk of the code, loading it on a miss; print the error and push nothing on failure. */
+        bool push(lua_State* L, const char* code, size_t size, const char* chunk_name){
+            std::uint64_t hash = fnv1a_hash(code, size);
+            bool named_after_source = chunk_name == code;
+            auto found = m_index.find(hash);
+            if( found != m_index.end() ){
+                entry& cached = *found->second;
+                if( cached.matches(code, size, chunk_name) ){
+                    ++m_hits;
+                    m_entries.splice(m_entries.begin(), m_entries, found->second);
+                    lua_rawgeti(L, LUA_REGISTRYINDEX, cached.m_ref);
+                    return true;
+                }
+                // Same hash for another source or chunk name, the new chunk replaces the cached one.
+                lua_ref_cache::release(L, cached.m_ref);
+                m_entries.erase(found->second);
+                m_index.erase(found);
+            }
+
+            ++m_misses;
+            if( !load(L, code, size, chunk_name) ){
+                return false;
+            }
+            if( m_capacity == 0 ){
+                return true;
+            }
+            if( m_entries.size() >= m_capacity ){
+                evict(L);
+            }
+            lua_pushvalue(L, -1);
+            m_entries.push_front(entry{ hash, std::string(code, size), named_after_source ? std::string() : std::string(chunk_name), named_after_source, lua_ref_cache::acquire(L) });
+            m_index[hash] = m_entries.begin();
+            return true;
+        }
+    };
+
+
     struct script{
+        /** @brief Run the code, its results being left on the stack. The compiled chunk is cached for the next calls. */
         static void do_string(lua_State* L, const char* code){
-            int res = luaL_dostring(L, code);
-            if( res != LUA_OK ){
-                if( lua_pcall(L, 0, LUA_MULTRET, 0) ){
-                    printf("Error: %s \n", lua_tostring(L, -1));
-                    lua_pop(L, 1);
-                }
+            if( script_cache::get(L).push(L, code, strlen(code), code) ){
+                run_chunk(L);
             }
         }
 
+        /**
+         * @brief Run the file, its results being left on the stack. The file is mapped in memory each time but compiled only once.
+         * The file must not be truncated while it is mapped: reading the missing pages raises SIGBUS (on POSIX systems),
+         * which kills the process, whereas luaL_loadfile would only return a read error.
+         */
         static void do_file(lua_State* L, const char* file){
-            int res = luaL_dofile(L, file);
-            if( res != LUA_OK ){
-                if( lua_pcall(L, 0, LUA_MULTRET, 0) ){
-                    printf("Error: %s \n", lua_tostring(L, -1));
-                    lua_pop(L, 1);
-                }
+            mapped_file source(file);
+            if( !source.valid() ){
+                printf("Error: cannot open %s \n", file);
+                return;
+            }
+            std::string chunk_name = std::string("@") + file;
+            if( script_cache::get(L).push(L, source.chunk(), source.chunk_size(), chunk_name.c_str()) ){
+                run_chunk(L);
             }
         }
     };
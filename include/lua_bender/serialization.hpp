@@ -0,0 +1,662 @@
+#ifndef LUA_BENDER_SERIALIZATION_HPP
+#define LUA_BENDER_SERIALIZATION_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "any.hpp"
+#include "user_data.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// This file serializes Lua values, and lua_any_t trees, to a compact binary format.
+// Every value starts with a tag byte, the integers and lengths are LEB128 varints (zigzag encoded for the signed integers)
+// and the floats are stored as 8 little endian bytes:
+//
+// nil, false, true                         tag only
+// integer                                  tag, signed varint
+// float                                    tag, 8 bytes
+// string                                   tag, varint length, bytes
+// table                                    tag, varint array size, varint hash size, array values, then key and value pairs
+// reference to a table already written     tag, varint index of the table in writing order (shared tables and cycles)
+// user data                                tag, varint name length, name, varint size, bytes
+//
+// Only the user data types registered with register_serializable_user_data are supported, they must be trivially copyable.
+// The writer streams to any sink providing write(const char* data, std::size_t size), which may return false on failure
+// as file_sink does, and both the writer and the reader stop at the same nesting depth. The reader decodes straight
+// from a memory block, e.g. a memory mapped file, pushing the strings without any intermediate copy.
+//
+// std::string bytes = lua_bender::serialize(L, -1);
+// lua_bender::deserialize(L, bytes.data(), bytes.size());
+
+namespace lua_bender{
+    enum class binary_tag : std::uint8_t{
+        nil         = 0,
+        false_value = 1,
+        true_value  = 2,
+        integer     = 3,
+        number      = 4,
+        string      = 5,
+        table       = 6,
+        reference   = 7,
+        user_data   = 8
+    };
+
+    /** @brief Trivially copyable user data type which can be serialized, identified by its user data type name. */
+    struct serializable_user_data{
+        const std::string* m_name;
+        std::size_t        m_size;
+        void*              (*m_create)(const char* bytes);
+
+        static std::vector<serializable_user_data>& types(){
+            static std::vector<serializable_user_data> s_types;
+            return s_types;
+        }
+
+        static const serializable_user_data* find(const char* name, std::size_t length){
+            for(const serializable_user_data& type : types()){
+                if( type.m_name->size() == length && std::memcmp(type.m_name->data(), name, length) == 0 ){
+                    return &type;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Return the registered type of the user data at the given index, or null.
+         * The type is found by the __name of the value metatable, which must also be the metatable registered under that name:
+         * the other registered types are not looked up, and their lazily bound metatables are left as they are.
+         */
+        static const serializable_user_data* find(lua_State* L, int index){
+            if( !lua_getmetatable(L, index) ){
+                return nullptr;
+            }
+            const serializable_user_data* res = nullptr;
+            if( lua_getfield(L, -1, "__name") == LUA_TSTRING ){
+                size_t length = 0;
+                const char* name = lua_tolstring(L, -1, &length);
+                res = find(name, length);
+                if( res != nullptr ){
+                    luaL_getmetatable(L, res->m_name->c_str());
+                    res = lua_rawequal(L, -1, -3) ? res : nullptr;
+                    lua_pop(L, 1);
+                }
+            }
+            lua_pop(L, 2);
+            return res;
+        }
+    };
+
+    /** @brief Allow the user data of type C, whose metatable must release it with destroy_instance, to be serialized. */
+    template<class C>
+    inline void register_serializable_user_data(){
+        static_assert(std::is_trivially_copyable<C>::value, "lua_bender::register_serializable_user_data expects a trivially copyable type");
+        const std::string* name = &user_data_type_name<C>::s_name;
+        if( serializable_user_data::find(name->data(), name->size()) == nullptr ){
+            serializable_user_data::types().push_back({ name, sizeof(C), [](const char* bytes) -> void*{
+                C* res = new C;
+                std::memcpy(static_cast<void*>(res), bytes, sizeof(C));
+                return res;
+            } });
+        }
+    }
+
+
+    // ******************************** WRITER ********************************
+
+    struct string_sink{
+        std::string& m_out;
+
+        void write(const char* data, std::size_t size){ m_out.append(data, size); }
+    };
+
+    struct file_sink{
+        std::FILE* m_file;
+
+        bool write(const char* data, std::size_t size){ return std::fwrite(data, 1, size, m_file) == size; }
+    };
+
+    template<class Sink>
+    struct binary_writer{
+        // Same nesting limit as binary_reader, so that everything written can be read back.
+        static constexpr int s_max_depth = 200;
+
+        Sink& m_sink;
+        bool  m_failed;
+        // Number of tables written so far, used for the references.
+        int   m_table_count;
+
+        binary_writer(Sink& sink): m_sink(sink), m_failed(), m_table_count(){}
+
+        /** @brief Write the bytes to the sink, a sink returning false failing the whole value. */
+        void write_bytes(const char* data, std::size_t size){
+            if constexpr( std::is_same<decltype(m_sink.write(data, size)), bool>::value ){
+                if( !m_sink.write(data, size) && !m_failed ){
+                    LUA_BENDER_LOG_ERROR("lua_bender::binary_writer the sink failed to write %d bytes", int(size));
+                    m_failed = true;
+                }
+            }
+            else{
+                m_sink.write(data, size);
+            }
+        }
+
+        void write_tag(binary_tag tag){
+            char byte = char(tag);
+            write_bytes(&byte, 1);
+        }
+
+        void write_varint(std::uint64_t value){
+            char bytes[10];
+            std::size_t size = 0;
+            do{
+                std::uint8_t byte = std::uint8_t(value & 0x7F);
+                value >>= 7;
+                bytes[size++] = char(value != 0 ? byte | 0x80 : byte);
+            } while( value != 0 );
+            write_bytes(bytes, size);
+        }
+
+        void write_integer(lua_Integer value){
+            write_tag(binary_tag::integer);
+            std::uint64_t bits = std::uint64_t(value);
+            write_varint(value < 0 ? ~(bits << 1) : bits << 1);
+        }
+
+        void write_number(double value){
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            char bytes[8];
+            for(int i = 0; i < 8; ++i){
+                bytes[i] = char((bits >> (8 * i)) & 0xFF);
+            }
+            write_tag(binary_tag::number);
+            write_bytes(bytes, 8);
+        }
+
+        void write_string(const char* str, std::size_t size){
+            write_tag(binary_tag::string);
+            write_varint(size);
+            write_bytes(str, size);
+        }
+
+        void fail(const char* type_name){
+            LUA_BENDER_LOG_ERROR("lua_bender::binary_writer cannot serialize a %s value", type_name);
+            m_failed = true;
+            write_tag(binary_tag::nil);
+        }
+
+        /** @brief Fail the values nested deeper than s_max_depth, which the reader would reject. */
+        bool too_deep(int depth){
+            if( depth <= s_max_depth ){
+                return false;
+            }
+            LUA_BENDER_LOG_ERROR("lua_bender::binary_writer cannot serialize values nested deeper than %d levels", s_max_depth);
+            m_failed = true;
+            write_tag(binary_tag::nil);
+            return true;
+        }
+
+        /** @brief Write the value at the given index, tables being indexed in the table at the visited index. */
+        void write(lua_State* L, int index, int visited, int depth){
+            if( too_deep(depth) ){
+                return;
+            }
+            index = lua_absindex(L, index);
+            int type = lua_type(L, index);
+            switch( type ){
+                case LUA_TNIL:
+                    write_tag(binary_tag::nil);
+                    break;
+                case LUA_TBOOLEAN:
+                    write_tag(lua_toboolean(L, index) ? binary_tag::true_value : binary_tag::false_value);
+                    break;
+                case LUA_TNUMBER:
+                    if( lua_isinteger(L, index) ){
+                        write_integer(lua_tointeger(L, index));
+                    }
+                    else{
+                        write_number(double(lua_tonumber(L, index)));
+                    }
+                    break;
+                case LUA_TSTRING:{
+                    size_t length = 0;
+                    const char* str = lua_tolstring(L, index, &length);
+                    write_string(str, length);
+                    break;
+                }
+                case LUA_TTABLE:
+                    write_table(L, index, visited, depth);
+                    break;
+                case LUA_TUSERDATA:{
+                    const serializable_user_data* udata_type = serializable_user_data::find(L, index);
+                    user_data* udata = udata_type != nullptr ? user_data::check(L, index) : nullptr;
+                    if( udata == nullptr || udata->m_data == nullptr ){
+                        fail(lua_typename(L, type));
+                        break;
+                    }
+                    write_tag(binary_tag::user_data);
+                    write_varint(udata_type->m_name->size());
+                    write_bytes(udata_type->m_name->data(), udata_type->m_name->size());
+                    write_varint(udata_type->m_size);
+                    write_bytes(static_cast<const char*>(udata->m_data), udata_type->m_size);
+                    break;
+                }
+                default:
+                    fail(lua_typename(L, type));
+                    break;
+            }
+        }
+
+        void write_table(lua_State* L, int index, int visited, int depth){
+            luaL_checkstack(L, 4, "lua_bender::binary_writer");
+            lua_pushvalue(L, index);
+            if( lua_rawget(L, visited) == LUA_TNUMBER ){
+                write_tag(binary_tag::reference);
+                write_varint(std::uint64_t(lua_tointeger(L, -1)));
+                lua_pop(L, 1);
+                return;
+            }
+            lua_pop(L, 1);
+            lua_pushvalue(L, index);
+            lua_pushinteger(L, m_table_count++);
+            lua_rawset(L, visited);
+
+            lua_Integer array_size = lua_Integer(lua_rawlen(L, index));
+            std::uint64_t hash_size = 0;
+            lua_pushnil(L);
+            while( lua_next(L, index) ){
+                lua_pop(L, 1);
+                hash_size += is_array_key(L, -1, array_size) ? 0 : 1;
+            }
+
+            write_tag(binary_tag::table);
+            write_varint(std::uint64_t(array_size));
+            write_varint(hash_size);
+            for(lua_Integer i = 1; i <= array_size; ++i){
+                lua_rawgeti(L, index, i);
+                write(L, -1, visited, depth + 1);
+                lua_pop(L, 1);
+            }
+            lua_pushnil(L);
+            while( lua_next(L, index) ){
+                if( !is_array_key(L, -2, array_size) ){
+                    write(L, -2, visited, depth + 1);
+                    write(L, -1, visited, depth + 1);
+                }
+                lua_pop(L, 1);
+            }
+        }
+
+        /** @brief Write the value at the given index, return false if it contains unsupported values (written as nil). */
+        bool write(lua_State* L, int index){
+            index = lua_absindex(L, index);
+            lua_newtable(L);
+            write(L, index, lua_gettop(L), 0);
+            lua_pop(L, 1);
+            return !m_failed;
+        }
+
+        /** @brief Write a lua_any_t tree, tables shared in the tree being written once. */
+        bool write(const lua_any_t& value){
+            std::vector< std::pair<const lua_any_table*, std::uint64_t> > visited;
+            write(value, visited, 0);
+            return !m_failed;
+        }
+
+        void write(const lua_any_t& value, std::vector< std::pair<const lua_any_table*, std::uint64_t> >& visited, int depth){
+            if( too_deep(depth) ){
+                return;
+            }
+            switch( value.m_lua_type ){
+                case LUA_TNIL:
+                case LUA_TNONE:
+                    write_tag(binary_tag::nil);
+                    break;
+                case LUA_TBOOLEAN:
+                    write_tag(value.m_number != 0 ? binary_tag::true_value : binary_tag::false_value);
+                    break;
+                case LUA_TNUMBER:
+                    if( value.is_integer() ){
+                        write_integer(value.m_integer);
+                    }
+                    else{
+                        write_number(double(value.m_number));
+                    }
+                    break;
+                case LUA_TSTRING:
+                    write_string(value.c_str(), value.string_size());
+                    break;
+                case LUA_TTABLE:{
+                    if( value.m_small_size == lua_any_t::s_owned_handle ){
+                        value.push_handle(value.m_handle.m_state);
+                        write(value.m_handle.m_state, -1);
+                        lua_pop(value.m_handle.m_state, 1);
+                        break;
+                    }
+                    const lua_any_table* table = value.m_table;
+                    for(const auto& entry : visited){
+                        if( entry.first == table ){
+                            write_tag(binary_tag::reference);
+                            write_varint(entry.second);
+                            return;
+                        }
+                    }
+                    visited.push_back({ table, std::uint64_t(m_table_count++) });
+                    write_tag(binary_tag::table);
+                    write_varint(table->m_array_size);
+                    write_varint(table->m_hash_size);
+                    for(std::size_t i = 0; i < table->m_array_size; ++i){
+                        write(table->m_array[i], visited, depth + 1);
+                    }
+                    for(std::size_t i = 0; i < table->m_hash_size; ++i){
+                        write(table->m_hash[i].m_key, visited, depth + 1);
+                        write(table->m_hash[i].m_value, visited, depth + 1);
+                    }
+                    break;
+                }
+                default:
+                    fail("lua_any_t");
+                    break;
+            }
+        }
+    };
+
+
+    // ******************************** READER ********************************
+
+    struct binary_reader{
+        // Nesting limit, protecting the C stack against malformed data.
+        static constexpr int s_max_depth = 200;
+
+        const char* m_data;
+        std::size_t m_size;
+        std::size_t m_position;
+
+        binary_reader(const char* data, std::size_t size): m_data(data), m_size(size), m_position(){}
+
+        bool at_end() const{ return m_position >= m_size; }
+
+        bool read_byte(std::uint8_t& res){
+            if( m_position >= m_size ){
+                return false;
+            }
+            res = std::uint8_t(m_data[m_position++]);
+            return true;
+        }
+
+        bool read_varint(std::uint64_t& res){
+            res = 0;
+            for(int shift = 0; shift < 64; shift += 7){
+                std::uint8_t byte;
+                if( !read_byte(byte) ){
+                    return false;
+                }
+                res |= std::uint64_t(byte & 0x7F) << shift;
+                if( (byte & 0x80) == 0 ){
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** @brief Point to the next size bytes and skip them, without copying. */
+        bool read_bytes(std::uint64_t size, const char*& res){
+            if( size > m_size - m_position ){
+                return false;
+            }
+            res = m_data + m_position;
+            m_position += std::size_t(size);
+            return true;
+        }
+
+        bool read_number(double& res){
+            const char* bytes;
+            if( !read_bytes(8, bytes) ){
+                return false;
+            }
+            std::uint64_t bits = 0;
+            for(int i = 0; i < 8; ++i){
+                bits |= std::uint64_t(std::uint8_t(bytes[i])) << (8 * i);
+            }
+            std::memcpy(&res, &bits, sizeof(res));
+            return true;
+        }
+
+        /** @brief Read the sizes of a table, each value taking at least one byte. */
+        bool read_table_sizes(std::uint64_t& array_size, std::uint64_t& hash_size){
+            if( !read_varint(array_size) || !read_varint(hash_size) ){
+                return false;
+            }
+            std::uint64_t left = m_size - m_position;
+            return array_size <= left && hash_size <= (left - array_size) / 2;
+        }
+
+        static lua_Integer decode_integer(std::uint64_t bits){
+            return lua_Integer((bits & 1) != 0 ? ~(bits >> 1) : bits >> 1);
+        }
+
+        /** @brief Decode the next value onto the stack, tables being indexed by position in the table at the tables index. */
+        bool read(lua_State* L, int tables, int depth){
+            std::uint8_t tag;
+            std::uint64_t size;
+            const char* bytes;
+            double number;
+            if( depth > s_max_depth || !read_byte(tag) || !lua_checkstack(L, 4) ){
+                return false;
+            }
+
+            switch( binary_tag(tag) ){
+                case binary_tag::nil:
+                    lua_pushnil(L);
+                    return true;
+                case binary_tag::false_value:
+                case binary_tag::true_value:
+                    lua_pushboolean(L, binary_tag(tag) == binary_tag::true_value);
+                    return true;
+                case binary_tag::integer:
+                    if( !read_varint(size) ){
+                        return false;
+                    }
+                    lua_pushinteger(L, decode_integer(size));
+                    return true;
+                case binary_tag::number:
+                    if( !read_number(number) ){
+                        return false;
+                    }
+                    lua_pushnumber(L, lua_Number(number));
+                    return true;
+                case binary_tag::string:
+                    if( !read_varint(size) || !read_bytes(size, bytes) ){
+                        return false;
+                    }
+                    lua_pushlstring(L, bytes, std::size_t(size));
+                    return true;
+                case binary_tag::reference:
+                    if( !read_varint(size) ){
+                        return false;
+                    }
+                    return lua_rawgeti(L, tables, lua_Integer(size) + 1) == LUA_TTABLE;
+                case binary_tag::table:{
+                    std::uint64_t array_size, hash_size;
+                    if( !read_table_sizes(array_size, hash_size) ){
+                        return false;
+                    }
+                    lua_createtable(L, int(array_size), int(hash_size));
+                    lua_pushvalue(L, -1);
+                    lua_rawseti(L, tables, lua_Integer(lua_rawlen(L, tables)) + 1);
+                    for(std::uint64_t i = 1; i <= array_size; ++i){
+                        if( !read(L, tables, depth + 1) ){
+                            return false;
+                        }
+                        lua_rawseti(L, -2, lua_Integer(i));
+                    }
+                    for(std::uint64_t i = 0; i < hash_size; ++i){
+                        if( !read(L, tables, depth + 1) || !read(L, tables, depth + 1) || lua_isnil(L, -2) ){
+                            return false;
+                        }
+                        // A NaN key would raise an error in lua_rawset.
+                        if( lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) != lua_tonumber(L, -2) ){
+                            return false;
+                        }
+                        lua_rawset(L, -3);
+                    }
+                    return true;
+                }
+                case binary_tag::user_data:{
+                    const char* name;
+                    std::uint64_t name_size;
+                    if( !read_varint(name_size) || !read_bytes(name_size, name) || !read_varint(size) || !read_bytes(size, bytes) ){
+                        return false;
+                    }
+                    const serializable_user_data* type = serializable_user_data::find(name, std::size_t(name_size));
+                    if( type == nullptr || type->m_size != size ){
+                        LUA_BENDER_LOG_ERROR("lua_bender::binary_reader unknown user data type %.*s", int(name_size), name);
+                        return false;
+                    }
+                    user_data::push(L, type->m_create(bytes), type->m_name->c_str(), true);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** @brief Decode the next value onto the stack, return false and push nothing if the data is invalid. */
+        bool read(lua_State* L){
+            int top = lua_gettop(L);
+            lua_newtable(L);
+            bool res = read(L, top + 1, 0);
+            if( !res ){
+                LUA_BENDER_LOG_ERROR("lua_bender::binary_reader invalid data at offset %d", int(m_position));
+                lua_settop(L, top);
+                return false;
+            }
+            lua_remove(L, top + 1);
+            return true;
+        }
+
+        /** @brief Decode the next value into a lua_any_t, the tables and long strings being allocated in the arena. */
+        bool read(lua_any_t& res, lua_any_arena& arena){
+            std::vector<lua_any_table*> tables;
+            if( !read(res, arena, tables, 0) ){
+                LUA_BENDER_LOG_ERROR("lua_bender::binary_reader invalid data at offset %d", int(m_position));
+                res.reset();
+                return false;
+            }
+            return true;
+        }
+
+        bool read(lua_any_t& res, lua_any_arena& arena, std::vector<lua_any_table*>& tables, int depth){
+            std::uint8_t tag;
+            std::uint64_t size;
+            const char* bytes;
+            double number;
+            if( depth > s_max_depth || !read_byte(tag) ){
+                return false;
+            }
+
+            res.reset();
+            switch( binary_tag(tag) ){
+                case binary_tag::nil:
+                    return true;
+                case binary_tag::false_value:
+                case binary_tag::true_value:
+                    res.m_lua_type = LUA_TBOOLEAN;
+                    res.m_number = binary_tag(tag) == binary_tag::true_value;
+                    return true;
+                case binary_tag::integer:
+                    if( !read_varint(size) ){
+                        return false;
+                    }
+                    res.set_integer(decode_integer(size));
+                    return true;
+                case binary_tag::number:
+                    if( !read_number(number) ){
+                        return false;
+                    }
+                    res.set_number(lua_Number(number));
+                    return true;
+                case binary_tag::string:
+                    if( !read_varint(size) || !read_bytes(size, bytes) ){
+                        return false;
+                    }
+                    if( size > lua_any_t::s_small_capacity ){
+                        res.set_arena_string(arena.copy_string(bytes, std::size_t(size)), std::size_t(size));
+                    }
+                    else{
+                        res.set_string(bytes, std::size_t(size));
+                    }
+                    return true;
+                case binary_tag::reference:
+                    if( !read_varint(size) || size >= tables.size() ){
+                        return false;
+                    }
+                    res.m_lua_type = LUA_TTABLE;
+                    res.m_table = tables[std::size_t(size)];
+                    return true;
+                case binary_tag::table:{
+                    std::uint64_t array_size, hash_size;
+                    if( !read_table_sizes(array_size, hash_size) ){
+                        return false;
+                    }
+                    lua_any_table* table = arena.allocate_array<lua_any_table>(1);
+                    table->m_array = arena.allocate_array<lua_any_t>(std::size_t(array_size));
+                    table->m_array_size = std::size_t(array_size);
+                    table->m_hash = arena.allocate_array<lua_any_entry>(std::size_t(hash_size));
+                    table->m_hash_size = std::size_t(hash_size);
+                    tables.push_back(table);
+                    res.m_lua_type = LUA_TTABLE;
+                    res.m_table = table;
+                    for(std::size_t i = 0; i < table->m_array_size; ++i){
+                        if( !read(table->m_array[i], arena, tables, depth + 1) ){
+                            return false;
+                        }
+                    }
+                    for(std::size_t i = 0; i < table->m_hash_size; ++i){
+                        if( !read(table->m_hash[i].m_key, arena, tables, depth + 1) || !read(table->m_hash[i].m_value, arena, tables, depth + 1) ){
+                            return false;
+                        }
+                    }
+                    table->sort_entries();
+                    return true;
+                }
+                case binary_tag::user_data:
+                    // lua_any_t cannot own a user data outside of a state.
+                    return false;
+            }
+            return false;
+        }
+    };
+
+
+    // ******************************** HELPERS ********************************
+
+    /** @brief Serialize the value at the given index into a string. */
+    inline std::string serialize(lua_State* L, int index){
+        std::string res;
+        string_sink sink{ res };
+        binary_writer<string_sink>(sink).write(L, index);
+        return res;
+    }
+
+    /** @brief Serialize a lua_any_t tree into a string. */
+    inline std::string serialize(const lua_any_t& value){
+        std::string res;
+        string_sink sink{ res };
+        binary_writer<string_sink>(sink).write(value);
+        return res;
+    }
+
+    /** @brief Push the value serialized in the given memory block, return false and push nothing if it is invalid. */
+    inline bool deserialize(lua_State* L, const char* data, std::size_t size){
+        binary_reader reader(data, size);
+        return reader.read(L);
+    }
+}
+
+#endif
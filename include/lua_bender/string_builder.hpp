@@ -0,0 +1,259 @@
+#ifndef LUA_BENDER_STRING_BUILDER_HPP
+#define LUA_BENDER_STRING_BUILDER_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "functions.hpp"
+#include "metatable.hpp"
+#include "user_data.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// The string builder assembles text in a growable native buffer, so scripts avoid the quadratic copies and the
+// interned intermediate strings of repeated concatenations. A Lua string is only created by tostring, while C++
+// takes the final text over without any copy with string_builder::view or string_builder::release.
+//
+// lua_library lib({&lua_bender::string_builder::metatable()}, {});
+//
+// local b = string_builder.new(4096)
+// b:append("<li>", name, "</li>"):appendf("%s=%d;", key, count)
+// print(#b, tostring(b))
+
+namespace lua_bender{
+    struct string_builder{
+        std::string m_buffer;
+
+        string_builder(): m_buffer(){}
+
+        int size() const{ return int(m_buffer.size()); }
+        void reserve(int capacity){ m_buffer.reserve(std::size_t(capacity > 0 ? capacity : 0)); }
+        void clear(){ m_buffer.clear(); }
+
+        /** @brief Borrow the text, valid until the next modification of the builder. */
+        std::string_view view() const{ return std::string_view(m_buffer); }
+
+        /** @brief Move the text out of the builder, which is left empty. */
+        std::string release(){
+            std::string res = std::move(m_buffer);
+            // A moved-from string is only guaranteed to be valid, not empty.
+            m_buffer.clear();
+            return res;
+        }
+
+        /** @brief Append the given value with the same conversions as tostring, without creating a Lua string. */
+        void append_value(lua_State* L, int index){
+            size_t length = 0;
+            switch( lua_type(L, index) ){
+                case LUA_TSTRING:{
+                    const char* str = lua_tolstring(L, index, &length);
+                    m_buffer.append(str, length);
+                    break;
+                }
+                case LUA_TNUMBER:
+                    if( lua_isinteger(L, index) ){
+                        append_formatted("%lld", static_cast<long long>(lua_tointeger(L, index)));
+                    }
+                    else{
+                        std::size_t start = m_buffer.size();
+                        append_formatted("%.14g", double(lua_tonumber(L, index)));
+                        // Lua writes the floats looking like integers with a trailing ".0".
+                        if( m_buffer.find_first_of(".eEinfa", start) == std::string::npos ){
+                            m_buffer.append(".0");
+                        }
+                    }
+                    break;
+                case LUA_TBOOLEAN:
+                    m_buffer.append(lua_toboolean(L, index) ? "true" : "false");
+                    break;
+                case LUA_TUSERDATA:
+                    if( string_builder* other = test(L, index) ){
+                        m_buffer.append(other->m_buffer);
+                        break;
+                    }
+                    // fallthrough
+                default:
+                    luaL_argerror(L, index, "string, number or boolean expected");
+            }
+        }
+
+        /** @brief snprintf a single value at the end of the buffer, directly in place when the stack buffer is too small. */
+        template<typename V>
+        void append_formatted(const char* spec, V value){
+            char local[128];
+            int length = std::snprintf(local, sizeof(local), spec, value);
+            if( length < 0 ){
+                return;
+            }
+            if( std::size_t(length) < sizeof(local) ){
+                m_buffer.append(local, std::size_t(length));
+                return;
+            }
+            std::size_t start = m_buffer.size();
+            m_buffer.resize(start + std::size_t(length));
+            std::snprintf(&m_buffer[start], std::size_t(length) + 1, spec, value);
+        }
+
+        /** @brief Return the builder at the given index, or null if the value is not a string builder. */
+        static string_builder* test(lua_State* L, int index){
+            if( lua_type(L, index) != LUA_TUSERDATA || !lua_getmetatable(L, index) ){
+                return nullptr;
+            }
+            user_data::get_metatable(L, user_data_type_name<string_builder>::s_name.c_str());
+            bool is_builder = lua_rawequal(L, -1, -2);
+            lua_pop(L, 2);
+
+            user_data* udata = is_builder ? user_data::check(L, index) : nullptr;
+            return udata != nullptr ? static_cast<string_builder*>(udata->m_data) : nullptr;
+        }
+
+        static string_builder& check(lua_State* L, int index){
+            string_builder* self = test(L, index);
+            if( self == nullptr ){
+                luaL_argerror(L, index, "string_builder expected");
+            }
+            return *self;
+        }
+
+
+        // ******************************** METAMETHODS ********************************
+
+        /** @brief string_builder.new([capacity]) */
+        static int create(lua_State* L){
+            string_builder* self = new string_builder();
+            self->reserve(int(luaL_optinteger(L, 1, 0)));
+            user_data::push(L, self, user_data_type_name<string_builder>::s_name.c_str(), true);
+            return 1;
+        }
+
+        /** @brief builder:append(...) appends every argument and returns the builder for chaining. */
+        static int append(lua_State* L){
+            string_builder& self = check(L, 1);
+            int top = lua_gettop(L);
+            for(int i = 2; i <= top; ++i){
+                self.append_value(L, i);
+            }
+            lua_settop(L, 1);
+            return 1;
+        }
+
+        /**
+         * @brief builder:appendf(format, ...) formats natively, with the string.format conversions except %q.
+         * Returns the builder for chaining.
+         */
+        static int appendf(lua_State* L){
+            string_builder& self = check(L, 1);
+            size_t length = 0;
+            const char* format = luaL_checklstring(L, 2, &length);
+            const char* end = format + length;
+            int arg = 2;
+
+            while( format < end ){
+                const char* percent = static_cast<const char*>(std::memchr(format, '%', std::size_t(end - format)));
+                if( percent == nullptr ){
+                    self.m_buffer.append(format, std::size_t(end - format));
+                    break;
+                }
+                self.m_buffer.append(format, std::size_t(percent - format));
+                format = percent + 1;
+                if( format < end && *format == '%' ){
+                    self.m_buffer.push_back('%');
+                    ++format;
+                    continue;
+                }
+
+                // Flags, then width and precision of at most two digits each, as string.format.
+                char spec[32] = "%";
+                std::size_t spec_length = 1;
+                while( format < end && spec_length < 6 && std::strchr("-+ #0", *format) != nullptr ){
+                    spec[spec_length++] = *format++;
+                }
+                for(int digits = 0; format < end && digits < 2 && *format >= '0' && *format <= '9'; ++digits){
+                    spec[spec_length++] = *format++;
+                }
+                if( format < end && *format == '.' ){
+                    spec[spec_length++] = *format++;
+                    for(int digits = 0; format < end && digits < 2 && *format >= '0' && *format <= '9'; ++digits){
+                        spec[spec_length++] = *format++;
+                    }
+                }
+                if( format >= end ){
+                    return luaL_error(L, "invalid conversion '%s' to 'appendf'", spec);
+                }
+
+                char conversion = *format++;
+                ++arg;
+                switch( conversion ){
+                    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+                        spec[spec_length++] = 'l';
+                        spec[spec_length++] = 'l';
+                        spec[spec_length++] = conversion;
+                        self.append_formatted(spec, static_cast<long long>(luaL_checkinteger(L, arg)));
+                        break;
+                    case 'c':
+                        spec[spec_length++] = conversion;
+                        self.append_formatted(spec, int(luaL_checkinteger(L, arg)));
+                        break;
+                    case 'a': case 'A': case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+                        spec[spec_length++] = conversion;
+                        self.append_formatted(spec, double(luaL_checknumber(L, arg)));
+                        break;
+                    case 's':
+                        if( spec_length == 1 ){
+                            luaL_checkany(L, arg);
+                            if( lua_type(L, arg) == LUA_TSTRING || lua_type(L, arg) == LUA_TNUMBER || lua_type(L, arg) == LUA_TBOOLEAN ){
+                                self.append_value(L, arg);
+                                break;
+                            }
+                        }
+                        {
+                            const char* str = luaL_tolstring(L, arg, nullptr);
+                            spec[spec_length++] = conversion;
+                            self.append_formatted(spec, str);
+                            lua_pop(L, 1);
+                        }
+                        break;
+                    default:
+                        spec[spec_length++] = conversion;
+                        return luaL_error(L, "invalid conversion '%s' to 'appendf'", spec);
+                }
+            }
+
+            lua_settop(L, 1);
+            return 1;
+        }
+
+        static int len(lua_State* L){
+            lua_pushinteger(L, lua_Integer(check(L, 1).m_buffer.size()));
+            return 1;
+        }
+
+        static int to_string(lua_State* L){
+            const string_builder& self = check(L, 1);
+            lua_pushlstring(L, self.m_buffer.data(), self.m_buffer.size());
+            return 1;
+        }
+
+        /** @brief Metatable binding the builder type, shared by all the states. */
+        static lua_class_metatable<string_builder>& metatable(){
+            typedef lua_class_metatable<string_builder> metatable_type;
+            static metatable_type s_metatable({
+                {"new",        create},
+                {"__gc",       metatable_type::destroy_instance},
+                {"__len",      len},
+                {"__tostring", to_string},
+                {"append",     append},
+                {"appendf",    appendf},
+                {"reserve",    lua_bender_member_function(string_builder::reserve)},
+                {"clear",      lua_bender_member_function(string_builder::clear)}
+            });
+            return s_metatable;
+        }
+    };
+
+    template<> inline std::string user_data_type_name<string_builder>::s_name = "string_builder";
+}
+
+#endif
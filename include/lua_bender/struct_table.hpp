@@ -0,0 +1,98 @@
+#ifndef LUA_BENDER_STRUCT_TABLE_HPP
+#define LUA_BENDER_STRUCT_TABLE_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "containers.hpp"
+#include "functions.hpp"
+
+// This file extends the member pointers logic of the initializers to decode a whole Lua table into a structure, and back.
+// Once the data members of a structure are registered, the structure can be read from and pushed as a table,
+// including as an element of the standard containers and as a member of another registered structure.
+//
+// struct server_config{ std::string m_host; int m_port; std::vector<std::string> m_routes; };
+// lua_bender_register_struct_fields(server_config, m_host, m_port, m_routes);
+//
+// server_config config;
+// lua_bender::check_struct(L, -1, config);  // from { m_host = "localhost", m_port = 80, m_routes = {"/"} }
+
+#ifndef LUA_BENDER_NO_BOOST
+#define boost_stringize_member(r, data, index, elem) BOOST_PP_COMMA_IF(index) BOOST_PP_STRINGIZE(elem)
+
+// The Lua field names are the names of the data members.
+#define lua_bender_register_struct_fields(type, ...)\
+    template<> struct lua_bender::struct_fields<type> :\
+    lua_bender::table_struct<type, BOOST_PP_SEQ_FOR_EACH_I(boost_get_member_ptr, type, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__))>{\
+        static constexpr bool s_registered = true;\
+        static const char* const* names(){\
+            static const char* const s_names[] = {BOOST_PP_SEQ_FOR_EACH_I(boost_stringize_member, type, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__))};\
+            return s_names;\
+        }\
+    }
+#endif // LUA_BENDER_NO_BOOST
+
+namespace lua_bender{
+    /**
+     * @brief Read and push a structure as a table of the given data members.
+     * The field names are provided by struct_fields<C>::names(), in the same order as the members.
+     */
+    template<class C, auto ...members>
+    struct table_struct{
+        static constexpr int s_field_count = int(sizeof...(members));
+
+        /** @brief Set the members of obj from the fields of the table at the given index, missing fields are left untouched. */
+        static void check(lua_State* L, int index, C& obj){
+            index = lua_absindex(L, index);
+            luaL_checktype(L, index, LUA_TTABLE);
+            luaL_checkstack(L, s_field_count + 1, "lua_bender::table_struct");
+
+            // All the fields are resolved at once into consecutive stack slots, then converted in place.
+            const char* const* names = struct_fields<C>::names();
+            int first_slot = lua_gettop(L) + 1;
+            for(int i = 0; i < s_field_count; ++i){
+                lua_getfield(L, index, names[i]);
+            }
+            check_fields(L, first_slot, obj, std::make_integer_sequence<int, s_field_count>());
+            lua_settop(L, first_slot - 1);
+        }
+
+        static int push(lua_State* L, const C& obj){
+            const char* const* names = struct_fields<C>::names();
+            luaL_checkstack(L, 2, "lua_bender::table_struct");
+            lua_createtable(L, 0, s_field_count);
+            push_fields(L, names, obj, std::make_integer_sequence<int, s_field_count>());
+            return 1;
+        }
+
+        template<int ...list>
+        static void check_fields(lua_State* L, int first_slot, C& obj, std::integer_sequence<int, list...>){
+            (check_field(L, first_slot + list, obj.*members), ...);
+        }
+
+        template<typename T>
+        static void check_field(lua_State* L, int slot, T& member){
+            if( !lua_isnil(L, slot) ){
+                member = sequence_element<T>::check_at(L, slot);
+            }
+        }
+
+        template<int ...list>
+        static void push_fields(lua_State* L, const char* const* names, const C& obj, std::integer_sequence<int, list...>){
+            ((sequence_element< typename std::decay<decltype(obj.*members)>::type >::push(L, obj.*members), lua_setfield(L, -2, names[list])), ...);
+        }
+    };
+
+    /** @brief Set the members of a registered structure from the table at the given index. */
+    template<class C>
+    inline void check_struct(lua_State* L, int index, C& obj){
+        struct_fields<C>::check(L, index, obj);
+    }
+
+    /** @brief Push a registered structure as a new table. */
+    template<class C>
+    inline int push_struct(lua_State* L, const C& obj){
+        return struct_fields<C>::push(L, obj);
+    }
+}
+
+#endif
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "lua_bender.hpp"
+#include <chrono>
 #include <iostream>
 #include <string>
 
@@ -177,6 +178,1040 @@ namespace lua_bender{
         }
     ));
 
+    // ******************************** BEHAVIOR CHECKS ********************************
+
+    // Each check_* function runs the main behavior of a feature in its own state and logs the failed expectations.
+    // Most expectations are written in Lua with assert, expect_script reporting the raised errors.
+
+    inline int& check_failures(){
+        static int s_failures = 0;
+        return s_failures;
+    }
+
+    /** @brief Log and count the expectation if it does not hold. */
+    inline bool expect(bool condition, const char* description){
+        if( !condition ){
+            LUA_BENDER_LOG_ERROR("Check failed: %s", description);
+            ++check_failures();
+        }
+        return condition;
+    }
+
+    /** @brief Run the code and count a failure if it raised an error, the stack being left as it was. */
+    inline bool expect_script(lua_State* L, const char* code){
+        int top = lua_gettop(L);
+        if( luaL_dostring(L, code) != LUA_OK ){
+            LUA_BENDER_LOG_ERROR("Check failed: %s", lua_tostring(L, -1));
+            ++check_failures();
+            lua_settop(L, top);
+            return false;
+        }
+        lua_settop(L, top);
+        return true;
+    }
+
+    inline void check_lazy_binding(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        test_lib->bind_lazy(L);
+
+        lazy_binding_stats stats = lua_library::get_lazy_stats(L);
+        expect(stats.m_registered == 1 && stats.m_materialized == 0, "bind_lazy only installs the loader stubs");
+        expect(luaL_getmetatable(L, "test_struct") == LUA_TNIL, "no metatable before the first use");
+        lua_pop(L, 1);
+
+        expect_script(L, "local object = test_struct.new()\n"
+                         "object:set_int_value(7)\n"
+                         "assert(object:get_int_value() == 7)\n"
+                         "assert(getmetatable(object) == test_struct)");
+        stats = lua_library::get_lazy_stats(L);
+        expect(stats.m_materialized == 1, "reading the global creates the metatable once");
+        expect_script(L, "assert(test_template_int(3) == 3)");
+
+        lua_close(L);
+    }
+
+    inline void check_modules(){
+        lua_library lib({}, {{"twice", lua_bender_function(test_template<int>)}});
+        lib.set_function("strings", {"echo", lua_bender_function(test_template<std::string>)});
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        lib.bind_module(L, "test_module");
+        expect_script(L, "assert(twice == nil)\n"
+                         "assert(test_module.twice(21) == 21)\n"
+                         "assert(rawget(test_module, 'twice') ~= nil)\n"
+                         "assert(test_module.strings.echo('a') == 'a')\n"
+                         "assert(require('test_module') == test_module)\n"
+                         "assert(test_module.missing == nil)");
+        lua_close(L);
+
+        L = luaL_newstate();
+        luaL_openlibs(L);
+        lib.preload_module(L, "test_module");
+        expect_script(L, "assert(test_module == nil)\n"
+                         "local lib = require('test_module')\n"
+                         "assert(lib.twice(2) == 2 and lib.strings.echo('b') == 'b')");
+        lua_close(L);
+    }
+
+    inline void check_dynamic_fields(){
+        lua_class_metatable<test_struct> metatable({
+            {"new",             lua_class_metatable<test_struct>::create_instance<>},
+            {"__gc",            lua_class_metatable<test_struct>::destroy_instance},
+            {"get_int_value",   lua_bender_member_function(test_struct::get_int_value)},
+            {"test_return_ref", lua_bender_member_function(test_struct::test_return_ref)}
+        }, true);
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        metatable.create_metatable(L);
+        expect_script(L, "local object = test_struct.new()\n"
+                         "assert(object.label == nil)\n"
+                         "object.label = 'player'\n"
+                         "assert(object.label == 'player')\n"
+                         "local handle = object:test_return_ref()\n"
+                         "assert(rawequal(handle, object) == false and handle.label == nil)\n"
+                         "assert(object:get_int_value() == 0)\n"
+                         "assert(not pcall(function() object.get_int_value = 1 end))\n"
+                         "assert(test_struct.new().label == nil)");
+
+        test_struct* first = new test_struct();
+        value<test_struct* const&>::push(L, first);
+        lua_setglobal(L, "first");
+        expect_script(L, "first.label = 'stale'\n"
+                         "first = nil\n"
+                         "collectgarbage()");
+        delete first;
+        test_struct* second = new test_struct();
+        value<test_struct* const&>::push(L, second);
+        lua_setglobal(L, "second");
+        expect_script(L, "assert(second.label == nil)");
+        lua_close(L);
+        delete second;
+    }
+
+    enum class test_color{ red, green, blue };
+
+    inline test_color test_next_color(test_color color){
+        return static_cast<test_color>((static_cast<int>(color) + 1) % 3);
+    }
+
+    static constexpr enum_entry<test_color> test_color_entries[] = {
+        {"red", test_color::red}, {"green", test_color::green}, {"blue", test_color::blue}
+    };
+
+    inline void check_enums(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_enum(L, "test_color", test_color_entries);
+        bind_function(L, "test_next_color", lua_bender_function(test_next_color));
+        expect_script(L, "assert(test_color.red == 0 and test_color.blue == 2)\n"
+                         "assert(test_next_color(test_color.green) == test_color.blue)\n"
+                         "assert(test_next_color(test_color.blue) == test_color.red)\n"
+                         "assert(not pcall(function() test_color.red = 4 end))\n"
+                         "local count = 0\n"
+                         "for name, value in pairs(test_color) do count = count + 1 end\n"
+                         "assert(count == 3)");
+        lua_close(L);
+    }
+
+    inline std::weak_ptr<test_struct> test_last_shared;
+
+    inline std::shared_ptr<test_struct> test_make_shared(int value){
+        std::shared_ptr<test_struct> res = std::make_shared<test_struct>();
+        res->set_int_value(value);
+        test_last_shared = res;
+        return res;
+    }
+
+    inline int test_take_unique(std::unique_ptr<test_struct> value){
+        return value != nullptr ? value->get_int_value() : -1;
+    }
+
+    inline void check_smart_pointers(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        test_lib->bind(L);
+        bind_function(L, "test_make_shared", lua_bender_function(test_make_shared));
+        bind_function(L, "test_take_unique", lua_bender_function(test_take_unique));
+        expect_script(L, "assert(test_take_unique(test_make_shared(1)) == -1)\n"
+                         "shared = test_make_shared(5)\n"
+                         "assert(shared:get_int_value() == 5)\n"
+                         "local owned = test_struct.new()\n"
+                         "owned:set_int_value(3)\n"
+                         "assert(test_take_unique(owned) == 3)");
+        expect(test_last_shared.use_count() == 1, "the shared_ptr pushed to Lua shares the ownership");
+        lua_close(L);
+        expect(test_last_shared.expired(), "closing the state releases the shared_ptr");
+    }
+
+    inline std::vector<int> test_reverse(const std::vector<int>& values){
+        return std::vector<int>(values.rbegin(), values.rend());
+    }
+
+    inline std::array<double, 3> test_scale(const std::array<double, 3>& values, double factor){
+        return {values[0] * factor, values[1] * factor, values[2] * factor};
+    }
+
+    inline std::deque<std::string> test_prepend(std::deque<std::string> values, const std::string& value){
+        values.push_front(value);
+        return values;
+    }
+
+    inline void check_sequences(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_reverse", lua_bender_function(test_reverse));
+        bind_function(L, "test_scale", lua_bender_function(test_scale));
+        bind_function(L, "test_prepend", lua_bender_function(test_prepend));
+        expect_script(L, "local reversed = test_reverse({1, 2, 3})\n"
+                         "assert(#reversed == 3 and reversed[1] == 3 and reversed[3] == 1)\n"
+                         "assert(#test_reverse({}) == 0)\n"
+                         "local scaled = test_scale({1, 2, 3}, 2)\n"
+                         "assert(scaled[1] == 2 and scaled[3] == 6)\n"
+                         "assert(not pcall(test_scale, {1, 2}, 2))\n"
+                         "assert(not pcall(test_reverse, {1, 'x'}))\n"
+                         "local ok, message = pcall(test_reverse, {1, 2, 3, {}})\n"
+                         "assert(not ok and message:find('expected a valid integer, got table', 1, true))\n"
+                         "local words = test_prepend({'b', 'c'}, 'a')\n"
+                         "assert(table.concat(words) == 'abc')");
+        lua_close(L);
+    }
+
+    inline std::vector<int>                     test_view_values = {1, 2, 3};
+    inline std::vector<bool>                    test_view_flags = {true, false};
+    inline std::unordered_map<std::string, int> test_view_map = {{"a", 1}, {"b", 2}};
+
+    inline vector_view<int> test_get_values(){ return vector_view<int>(test_view_values); }
+    inline vector_view<bool> test_get_flags(){ return vector_view<bool>(test_view_flags); }
+    inline unordered_map_view<std::string, int> test_get_map(){ return unordered_map_view<std::string, int>(test_view_map); }
+
+    inline void check_views(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_get_values", lua_bender_function(test_get_values));
+        bind_function(L, "test_get_flags", lua_bender_function(test_get_flags));
+        bind_function(L, "test_get_map", lua_bender_function(test_get_map));
+        expect_script(L, "local values = test_get_values()\n"
+                         "assert(#values == 3 and values[2] == 2 and values[4] == nil)\n"
+                         "values[1] = 10\n"
+                         "values[4] = 4\n"
+                         "assert(not pcall(function() values[6] = 6 end))\n"
+                         "local sum = 0\n"
+                         "for i, value in ipairs(values) do sum = sum + value end\n"
+                         "assert(sum == 19)\n"
+                         "local flags = test_get_flags()\n"
+                         "assert(flags[1] == true and flags[2] == false)\n"
+                         "flags[2] = true\n"
+                         "local map = test_get_map()\n"
+                         "assert(map.a == 1 and map[true] == nil and #map == 2)\n"
+                         "assert(not pcall(function() map[true] = 1 end))\n"
+                         "map.c = 3\n"
+                         "map.a = nil\n"
+                         "local count = 0\n"
+                         "for key, value in pairs(map) do count = count + value end\n"
+                         "assert(count == 5)");
+        lua_close(L);
+        expect(test_view_values.size() == 4 && test_view_values[0] == 10, "the vector view writes to the vector");
+        expect(test_view_flags[1], "the vector<bool> view writes through the proxy");
+        expect(test_view_map.count("a") == 0 && test_view_map["c"] == 3, "the map view writes to the map");
+    }
+
+    inline std::map<std::string, int> test_invert(const std::unordered_map<int, std::string>& values){
+        std::map<std::string, int> res;
+        for(const auto& entry : values){
+            res[entry.second] = entry.first;
+        }
+        return res;
+    }
+
+    inline void check_associative_containers(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_invert", lua_bender_function(test_invert));
+        expect_script(L, "local inverted = test_invert({'a', 'b', [10] = 'c'})\n"
+                         "assert(inverted.a == 1 and inverted.b == 2 and inverted.c == 10)\n"
+                         "assert(next(test_invert({})) == nil)\n"
+                         "assert(not pcall(test_invert, {x = 'a'}))\n"
+                         "local ok, message = pcall(test_invert, {'a', 'b', 'c', x = 'd'})\n"
+                         "assert(not ok and message:find('expected a valid integer, got string', 1, true))");
+        lua_close(L);
+    }
+
+    inline void check_numeric_arrays(){
+        lua_library lib({&float32_array::metatable(), &float64_array::metatable(), &int32_array::metatable()}, {});
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        lib.bind(L);
+        expect_script(L, "local a = float32_array.from({1, 2, 3, 4, 5})\n"
+                         "local b = float32_array.new(5)\n"
+                         "b:fill(2)\n"
+                         "assert(#a == 5 and a[1] == 1 and a[6] == nil and a['1'] == nil)\n"
+                         "assert(a:dot(b) == 30 and a:sum() == 15)\n"
+                         "b:axpy(2, a)\n"
+                         "assert(b[5] == 12)\n"
+                         "b:scale(0.5)\n"
+                         "assert(b[5] == 6 and b:max() == 6 and b:min() == 2)\n"
+                         "b[1] = 9\n"
+                         "b:sort()\n"
+                         "assert(b[5] == 9)\n"
+                         "b:resize(2)\n"
+                         "assert(#b == 2 and #b:to_table() == 2)\n"
+                         "local c = float64_array.new(5)\n"
+                         "assert(not pcall(a.dot, a, c))\n"
+                         "assert(not pcall(a.axpy, a, 1, c))\n"
+                         "assert(not pcall(a.dot, a, {1, 2}))");
+        expect_script(L, "local i = int32_array.new(2)\n"
+                         "i:fill(2147483647)\n"
+                         "assert(i:sum() == 4294967294 and math.type(i:sum()) == 'integer')\n"
+                         "assert(i:dot(i) == 2 * 2147483647 * 2147483647)\n"
+                         "local n = int32_array.from({-3, 1, 2, -5, 7})\n"
+                         "assert(n:sum() == 2 and n:dot(n) == 88 and n:min() == -5 and n:max() == 7)\n"
+                         "n:axpy(-2, n)\n"
+                         "assert(n[1] == 3 and n[5] == -7)\n"
+                         "n:scale(3)\n"
+                         "assert(n[1] == 9 and n:sum() == -6)");
+        lua_close(L);
+    }
+
+    struct test_endpoint{
+        std::string m_host;
+        int         m_port;
+    };
+
+    struct test_config{
+        std::string                m_name;
+        test_endpoint              m_main;
+        std::vector<test_endpoint> m_backups;
+    };
+}
+
+lua_bender_register_struct_fields(lua_bender::test_endpoint, m_host, m_port);
+lua_bender_register_struct_fields(lua_bender::test_config, m_name, m_main, m_backups);
+
+namespace lua_bender{
+    inline int test_config_port_sum(const test_config& config){
+        int res = config.m_main.m_port;
+        for(const test_endpoint& backup : config.m_backups){
+            res += backup.m_port;
+        }
+        return res;
+    }
+
+    inline test_endpoint test_make_endpoint(const std::string& host, int port){
+        return test_endpoint{host, port};
+    }
+
+    inline void check_struct_tables(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_config_port_sum", lua_bender_function(test_config_port_sum));
+        bind_function(L, "test_make_endpoint", lua_bender_function(test_make_endpoint));
+        expect_script(L, "assert(test_config_port_sum({m_name = 'srv', m_main = {m_host = 'a', m_port = 80},\n"
+                         "                             m_backups = {{m_host = 'b', m_port = 1}, {m_port = 2}}}) == 83)\n"
+                         "local endpoint = test_make_endpoint('localhost', 8080)\n"
+                         "assert(type(endpoint) == 'table' and endpoint.m_host == 'localhost' and endpoint.m_port == 8080)");
+
+        luaL_dostring(L, "return {m_name = 'srv', m_main = {m_host = 'a', m_port = 80}}");
+        test_config config;
+        config.m_main.m_port = 0;
+        check_struct(L, -1, config);
+        lua_pop(L, 1);
+        expect(config.m_name == "srv" && config.m_main.m_host == "a" && config.m_main.m_port == 80 && config.m_backups.empty(), "check_struct decodes nested structures");
+        lua_close(L);
+    }
+
+    inline std::optional<std::string> test_find_name(int id){
+        if( id == 1 ){
+            return std::string("one");
+        }
+        return std::nullopt;
+    }
+
+    inline std::string test_describe(const std::variant<std::monostate, lua_Integer, double, std::string>& value){
+        switch( value.index() ){
+            case 0:  return "nil";
+            case 1:  return "integer";
+            case 2:  return "number";
+            default: return "string";
+        }
+    }
+
+    inline std::variant<std::monostate, double, std::string> test_parse(const std::string& text){
+        if( text.empty() ){
+            return std::monostate();
+        }
+        if( text[0] >= '0' && text[0] <= '9' ){
+            return std::stod(text);
+        }
+        return text;
+    }
+
+    inline void check_optional_variant(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_find_name", lua_bender_function(test_find_name));
+        bind_function(L, "test_describe", lua_bender_function(test_describe));
+        bind_function(L, "test_parse", lua_bender_function(test_parse));
+        expect_script(L, "assert(test_find_name(1) == 'one')\n"
+                         "assert(test_find_name(2) == nil)\n"
+                         "assert(test_describe(3) == 'integer')\n"
+                         "assert(test_describe(3.5) == 'number')\n"
+                         "assert(test_describe('x') == 'string')\n"
+                         "assert(test_describe(nil) == 'nil' and test_describe() == 'nil')\n"
+                         "assert(not pcall(test_describe, {}))\n"
+                         "assert(test_parse('') == nil)\n"
+                         "assert(test_parse('2.5') == 2.5)\n"
+                         "assert(test_parse('abc') == 'abc')");
+        lua_close(L);
+    }
+
+    inline double test_score(double x, double weight){
+        return x * weight;
+    }
+
+    inline std::string test_label(const std::string& prefix, int id){
+        return prefix + std::to_string(id);
+    }
+
+    inline std::int32_t test_round(float x){
+        return std::int32_t(x + 0.5f);
+    }
+
+    inline void check_batch_functions(){
+        lua_library lib({&float32_array::metatable(), &float64_array::metatable()}, {});
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        lib.bind(L);
+        lua_register(L, "test_score_batch", lua_bender_batch_function(test_score));
+        lua_register(L, "test_label_batch", lua_bender_batch_function(test_label));
+        lua_register(L, "test_round_batch", lua_bender_batch_function(test_round));
+        expect_script(L, "local scores = test_score_batch({1, 2, 3}, 0.5)\n"
+                         "assert(type(scores) == 'table' and #scores == 3 and scores[3] == 1.5)\n"
+                         "scores = test_score_batch({1, 2}, {3, 4})\n"
+                         "assert(scores[1] == 3 and scores[2] == 8)\n"
+                         "local typed = test_score_batch(float64_array.from({1, 2, 3}), 2)\n"
+                         "assert(getmetatable(typed) == float64_array and #typed == 3 and typed[2] == 4)\n"
+                         "assert(#test_score_batch({}, 1) == 0)\n"
+                         "assert(not pcall(test_score_batch, {1, 2}, {1}))\n"
+                         "assert(not pcall(test_score_batch, 1, 2))\n"
+                         "local labels = test_label_batch('item', {1, 2})\n"
+                         "assert(labels[1] == 'item1' and labels[2] == 'item2')\n"
+                         "local rounded = test_round_batch(float32_array.from({1.2, 2.7}))\n"
+                         "assert(type(rounded) == 'table' and rounded[1] == 1 and rounded[2] == 3)");
+        lua_close(L);
+    }
+
+    inline void check_columns(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        column_schema<float, std::string, int> schema("x", "name", "id");
+
+        luaL_dostring(L, "return { {x = 1.5, name = 'a', id = 7}, {x = 2, id = 8}, {name = 'c'} }");
+        auto columns = schema.extract(L, -1);
+        expect(std::get<0>(columns).size() == 3 && std::get<1>(columns).size() == 3 && std::get<2>(columns).size() == 3,
+               "column_schema keeps the columns at the same length");
+        expect(std::get<0>(columns)[0] == 1.5f && std::get<1>(columns)[0] == "a" && std::get<2>(columns)[1] == 8,
+               "column_schema reads the fields of each record");
+        expect(std::get<1>(columns)[1].empty() && std::get<2>(columns)[2] == 0, "column_schema appends default values for missing fields");
+
+        schema.extract(L, -1, columns);
+        expect(std::get<0>(columns).size() == 6 && std::get<1>(columns)[5] == "c", "column_schema appends to existing columns");
+        expect(lua_gettop(L) == 1, "column_schema leaves the stack as it was");
+        lua_pop(L, 1);
+
+        lua_pushcfunction(L, [](lua_State* L) -> int{
+            luaL_dostring(L, "return { {x = 1}, 'not a record' }");
+            column_schema<float> schema("x");
+            schema.extract(L, -1);
+            return 0;
+        });
+        expect(lua_pcall(L, 0, 0, 0) != LUA_OK, "column_schema raises an error on a record which is not a table");
+
+        lua_CFunction extract_wrong_field = [](lua_State* L) -> int{
+            luaL_dostring(L, "return { {x = 1, id = 2}, {x = 3, id = 'four'} }");
+            column_schema<float, int> schema("x", "id");
+            schema.extract(L, -1);
+            return 0;
+        };
+        lua_pushcfunction(L, extract_wrong_field);
+        expect(lua_pcall(L, 0, 0, 0) != LUA_OK && std::string(lua_tostring(L, -1)).find("expected a valid integer, got string") != std::string::npos,
+               "column_schema raises an error on a field of the wrong type");
+        lua_close(L);
+    }
+
+    inline void check_string_builder(){
+        lua_library lib({&string_builder::metatable()}, {});
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        lib.bind(L);
+        expect_script(L, "local b = string_builder.new(64)\n"
+                         "assert(b:append('<li>', 42, ' ', 1.5, ' ', true, '</li>') == b)\n"
+                         "assert(tostring(b) == '<li>42 1.5 true</li>')\n"
+                         "b:clear()\n"
+                         "b:append(2.0)\n"
+                         "assert(tostring(b) == '2.0' and #b == 3)\n"
+                         "b:clear()\n"
+                         "b:appendf('%s=%d;%5.2f|%x|%%', 'key', 7, 3.14159, 255)\n"
+                         "assert(tostring(b) == string.format('%s=%d;%5.2f|%x|%%', 'key', 7, 3.14159, 255))\n"
+                         "local other = string_builder.new()\n"
+                         "other:append('[', b, ']')\n"
+                         "assert(#other == #b + 2)\n"
+                         "assert(not pcall(b.append, b, {}))\n"
+                         "assert(not pcall(b.appendf, b, '%q', 'x'))\n"
+                         "assert(not pcall(b.appendf, b, '%d', 'x'))\n"
+                         "builder = b");
+
+        lua_getglobal(L, "builder");
+        string_builder& builder = string_builder::check(L, -1);
+        expect(builder.view().substr(0, 4) == "key=", "string_builder::view borrows the text");
+        std::string text = builder.release();
+        expect(text.substr(0, 4) == "key=" && builder.size() == 0, "string_builder::release moves the text out");
+        lua_pop(L, 1);
+        lua_close(L);
+    }
+
+    inline std::vector<int>           test_ids = {4, 5, 6};
+    inline std::map<std::string, int> test_counts = {{"a", 1}, {"b", 2}};
+
+    inline iterator_range<std::vector<int>::const_iterator> test_get_ids(){
+        return make_iterator_range(test_ids.cbegin(), test_ids.cend());
+    }
+
+    inline iterator_range<std::map<std::string, int>::const_iterator> test_get_counts(){
+        return make_iterator_range(test_counts.cbegin(), test_counts.cend());
+    }
+
+    inline auto test_countdown(int from){
+        return make_generator([from]() mutable -> std::optional<int>{
+            if( from <= 0 ){
+                return std::nullopt;
+            }
+            return from--;
+        });
+    }
+
+    inline int test_push_flags(lua_State* L){
+        return push_range(L, std::vector<bool>{true, false, true});
+    }
+
+    inline void check_iterators(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_get_ids", lua_bender_function(test_get_ids));
+        bind_function(L, "test_get_counts", lua_bender_function(test_get_counts));
+        bind_function(L, "test_countdown", lua_bender_function(test_countdown));
+        lua_register(L, "test_push_flags", test_push_flags);
+        expect_script(L, "local sum = 0\n"
+                         "for id in test_get_ids() do sum = sum + id end\n"
+                         "assert(sum == 15)\n"
+                         "local keys = ''\n"
+                         "for key, count in test_get_counts() do keys = keys .. key .. count end\n"
+                         "assert(keys == 'a1b2')\n"
+                         "local values = {}\n"
+                         "for value in test_countdown(3) do values[#values + 1] = value end\n"
+                         "assert(#values == 3 and values[1] == 3 and values[3] == 1)\n"
+                         "local flags = {}\n"
+                         "for flag in test_push_flags() do flags[#flags + 1] = flag end\n"
+                         "assert(#flags == 3 and flags[1] == true and flags[2] == false)\n"
+                         "local next_id = test_get_ids()\n"
+                         "next_id() next_id() next_id()\n"
+                         "assert(next_id() == nil and next_id() == nil)\n"
+                         "collectgarbage()");
+        lua_close(L);
+    }
+
+    inline void check_any_values(){
+        expect(sizeof(void*) != 8 || sizeof(lua_any_t) == 24, "lua_any_t stays at 24 bytes on 64 bits platforms");
+
+        lua_any_t small;
+        small.set_string("short", 5);
+        lua_any_t large;
+        large.set_string("a string longer than the inline capacity", 40);
+        expect(small.is_small_string() && !large.is_small_string(), "lua_any_t stores the short strings inline");
+
+        lua_any_t copy = large;
+        lua_any_t moved = std::move(copy);
+        expect(moved.str() == large.str() && copy.m_lua_type == LUA_TNIL, "lua_any_t copies the heap strings and moves them without copy");
+        copy = copy;
+        large = large;
+        large.set_string(large.c_str() + 2, 10);
+        expect(large.str() == "string lon" && large.is_small_string(), "lua_any_t can be assigned a part of itself");
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        luaL_dostring(L, "return 42, 'name', true, 'another string longer than the inline capacity'");
+        std::vector<lua_any_t> results;
+        lua_any_t::get_results(L, results);
+        expect(results.size() == 4 && results[0].get<int>() == 42 && results[1].get<std::string>() == "name",
+               "lua_any_t::get_results reads numbers and strings");
+        expect(results[2].get<bool>() && results[3].string_size() == 46, "lua_any_t::get_results reads booleans and long strings");
+        expect(results[1].get<const lua_any_table*>() == nullptr && results[1].get<test_struct*>() == nullptr,
+               "lua_any_t::get returns null pointers for values of another type");
+        lua_settop(L, 0);
+        lua_close(L);
+    }
+
+    inline void check_any_tables(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        luaL_dostring(L, "local shared = {1, 2}\n"
+                         "local config = {name = 'test', size = 3, [10] = 'ten', [true] = 'yes', shared = shared, again = shared, 'first'}\n"
+                         "config.self = config\n"
+                         "local deep = {}\n"
+                         "for i = 1, 300 do deep = {deep} end\n"
+                         "return config, print, deep");
+
+        lua_any_arena arena;
+        std::vector<lua_any_t> results;
+        lua_any_t::get_results(L, results, arena);
+        const lua_any_table* config = results[0].get<const lua_any_table*>();
+        expect(config != nullptr && config->m_array_size == 1 && config->m_array[0].str() == "first", "lua_any_arena captures the array part");
+        if( config != nullptr ){
+            expect(config->find("name") != nullptr && config->find("name")->str() == "test", "lua_any_table::find returns the value of a string key");
+            expect(config->find("size") != nullptr && config->find("size")->get<int>() == 3, "lua_any_table::find looks up every string key");
+            expect(config->find("missing") == nullptr && config->find("ten") == nullptr, "lua_any_table::find returns null for missing keys");
+            expect(config->find("self") != nullptr && config->find("self")->m_table == config, "lua_any_arena captures cycles once");
+            expect(config->find("shared")->m_table == config->find("again")->m_table, "lua_any_arena shares the tables reached twice");
+        }
+
+        expect(results[1].m_lua_type == LUA_TFUNCTION && results[1].push_handle(L) == LUA_TFUNCTION, "lua_any_arena keeps functions as references");
+        lua_pop(L, 1);
+
+        const lua_any_t* deep = &results[2];
+        int depth = 0;
+        while( deep->m_lua_type == LUA_TTABLE && deep->m_table->m_array_size > 0 ){
+            deep = &deep->m_table->m_array[0];
+            ++depth;
+        }
+        expect(depth == lua_any_t::s_max_depth && deep->m_lua_type == LUA_TNIL, "lua_any_arena reads the tables nested too deep as nil");
+
+        std::vector<lua_any_t> plain;
+        lua_any_t::get_results(L, plain);
+        expect(plain[0].m_lua_type == LUA_TNIL && plain[1].m_lua_type == LUA_TNIL, "tables and functions are read as nil without an arena");
+
+        arena.release_handles(L);
+        lua_settop(L, 0);
+        lua_close(L);
+    }
+
+    /** @brief Visitor describing each value with a letter of its converted type. */
+    struct test_type_visitor{
+        std::string& m_types;
+
+        void operator()(std::nullptr_t){ m_types += 'n'; }
+        void operator()(bool){ m_types += 'b'; }
+        void operator()(lua_Integer){ m_types += 'i'; }
+        void operator()(lua_Number){ m_types += 'f'; }
+        void operator()(std::string_view){ m_types += 's'; }
+        void operator()(lua_table_ref){ m_types += 't'; }
+        void operator()(lua_stack_ref reference){ m_types += reference.m_type == LUA_TFUNCTION ? 'u' : '?'; }
+    };
+
+    inline void check_visitors(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        luaL_dostring(L, "return nil, true, 3, 1.5, 'text', {10, 20, 30, name = 'x'}, print");
+        int top = lua_gettop(L);
+
+        std::string types;
+        visit_stack(L, 1, top, test_type_visitor{ types });
+        expect(types == "nbifstu", "visit_stack converts each value to its C++ counterpart");
+
+        lua_Integer sum = 0;
+        lua_Integer positions = 0;
+        visit_array(L, 6, [&](lua_Integer i, auto value){
+            positions += i;
+            if constexpr( std::is_same<decltype(value), lua_Integer>::value ){
+                sum += value;
+            }
+        });
+        expect(sum == 60 && positions == 6, "visit_array walks the array part in order");
+
+        std::string name;
+        int entries = 0;
+        visit_table(L, 6, [&](auto key, auto value){
+            ++entries;
+            if constexpr( std::is_same<decltype(key), std::string_view>::value && std::is_same<decltype(value), std::string_view>::value ){
+                name = std::string(key) + "=" + std::string(value);
+            }
+        });
+        expect(entries == 4 && name == "name=x", "visit_table gives the keys and the values without converting them in place");
+        expect(lua_gettop(L) == top, "the visitors leave the stack as it was");
+        lua_close(L);
+    }
+
+    inline bool test_is_null(test_struct* object){
+        return object == nullptr;
+    }
+
+    inline void check_typed_results(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_is_null", lua_bender_function(test_is_null));
+        expect_script(L, "assert(test_is_null(nil) and test_is_null())");
+
+        luaL_dostring(L, "return nil, 9007199254740993, 'name', 2.5");
+        auto [object, big, name, ratio] = lua_any_t::get_results<test_struct*, lua_Integer, std::string, double>(L);
+        expect(object == nullptr, "lua_any_t::get_results reads nil as a null pointer");
+        expect(big == 9007199254740993ll && name == "name" && ratio == 2.5, "lua_any_t::get_results converts with the value templates");
+
+        std::vector<lua_any_t> results;
+        lua_any_t::get_results(L, results);
+        expect(results[1].is_integer() && results[1].get<lua_Integer>() == 9007199254740993ll, "lua_any_t keeps the integers exact beyond 2^53");
+        expect(!results[3].is_integer() && results[3].get<double>() == 2.5 && results[3].get<int>() == 2, "lua_any_t keeps the floats apart from the integers");
+
+        std::string data = serialize(L, 2);
+        lua_any_arena arena;
+        lua_any_t decoded;
+        expect(binary_reader(data.data(), data.size()).read(decoded, arena) && decoded.get<lua_Integer>() == 9007199254740993ll,
+               "integers decoded into a lua_any_t stay exact");
+        lua_settop(L, 0);
+        lua_close(L);
+    }
+
+    inline lua_ref test_kept_callback;
+
+    inline void test_keep_callback(lua_ref callback){
+        test_kept_callback = std::move(callback);
+    }
+
+    inline void check_references(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        bind_function(L, "test_keep_callback", lua_bender_function(test_keep_callback));
+        expect_script(L, "test_keep_callback(function(x) return x * 2 end)\n"
+                         "collectgarbage()");
+        expect(test_kept_callback.push(L) == LUA_TFUNCTION, "lua_ref keeps a bound function parameter alive");
+        lua_pushinteger(L, 21);
+        lua_call(L, 1, 1);
+        expect(lua_tointeger(L, -1) == 42, "lua_ref pushes back the referenced value");
+        lua_pop(L, 1);
+        test_kept_callback.release();
+        expect(!test_kept_callback.valid(), "lua_ref::release empties the reference");
+
+        lua_newtable(L);
+        lua_ref first = lua_ref::pop(L);
+        int slot = first.m_ref;
+        lua_ref moved = std::move(first);
+        expect(!first.valid() && moved.m_ref == slot, "lua_ref moves the registry slot");
+        moved.release();
+        lua_pushboolean(L, 1);
+        lua_ref reused = lua_ref::pop(L);
+        expect(reused.m_ref == slot && reused.push() == LUA_TBOOLEAN, "lua_ref reuses the released slots");
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        lua_ref empty = lua_ref::pop(L);
+        expect(empty.m_ref == LUA_REFNIL && empty.push() == LUA_TNIL, "lua_ref of nil takes no slot");
+        lua_pop(L, 1);
+
+        luaL_dostring(L, "return {a = 1}, 'text', 3");
+        std::vector<lua_any_t> results;
+        lua_any_t::get_references(L, results);
+        lua_settop(L, 0);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        expect(results[0].push_handle(L) == LUA_TTABLE && lua_getfield(L, -1, "a") == LUA_TNUMBER, "get_references keeps the tables alive");
+        expect(results[1].str() == "text" && results[2].get<int>() == 3, "get_references decodes the other values");
+        lua_settop(L, 0);
+
+        results.clear();
+        reused.release();
+        empty.release();
+        lua_close(L);
+    }
+
+    struct test_point{
+        float m_x;
+        float m_y;
+    };
+
+    struct test_size{
+        int m_width;
+        int m_height;
+    };
+
+    template<> inline std::string user_data_type_name<test_point>::s_name = "test_point";
+    template<> inline std::string user_data_type_name<test_size>::s_name = "test_size";
+
+    inline void check_serialization(){
+        lua_class_metatable<test_point> point_metatable({
+            {"new",  lua_class_metatable<test_point>::create_instance<>},
+            {"__gc", lua_class_metatable<test_point>::destroy_instance}
+        });
+        lua_class_metatable<test_size> size_metatable({
+            {"new",  lua_class_metatable<test_size>::create_instance<>},
+            {"__gc", lua_class_metatable<test_size>::destroy_instance}
+        });
+        lua_library lib({&point_metatable, &size_metatable}, {});
+        register_serializable_user_data<test_point>();
+        register_serializable_user_data<test_size>();
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        lib.bind_lazy(L);
+        luaL_dostring(L, "local shared = {1}\n"
+                         "local t = {1, -7, 2.5, 'text', true, shared, name = 'a long string value', point = test_point.new(), big = 9007199254740993}\n"
+                         "t.self = t\n"
+                         "t.again = shared\n"
+                         "return t");
+        std::string data = serialize(L, -1);
+        lua_pop(L, 1);
+        expect(lua_library::get_lazy_stats(L).m_materialized == 1, "serializing a user data leaves the other lazy metatables as they are");
+        expect(deserialize(L, data.data(), data.size()), "deserialize reads back a serialized value");
+        lua_setglobal(L, "copy");
+        expect_script(L, "assert(copy[1] == 1 and math.type(copy[1]) == 'integer' and copy[3] == 2.5 and copy[4] == 'text')\n"
+                         "assert(copy.self == copy and copy.again == copy[6] and copy.big == 9007199254740993)\n"
+                         "assert(getmetatable(copy.point) == test_point and copy.name == 'a long string value')");
+        expect(!deserialize(L, data.data(), data.size() - 1), "deserialize rejects truncated data");
+
+        luaL_dostring(L, "local deep = {}\n"
+                         "for i = 1, 250 do deep = {deep} end\n"
+                         "return deep, 9007199254740993, {1, 2}");
+        std::string bytes;
+        string_sink sink{ bytes };
+        expect(!binary_writer<string_sink>(sink).write(L, 1), "binary_writer fails on values nested deeper than the reader accepts");
+
+        lua_any_arena arena;
+        std::vector<lua_any_t> results;
+        lua_any_t::get_results(L, results, arena);
+        lua_settop(L, 0);
+        std::string integer = serialize(results[1]);
+        expect(integer.size() > 0 && binary_tag(integer[0]) == binary_tag::integer, "lua_any_t integers are written with the integer tag");
+        expect(deserialize(L, integer.data(), integer.size()) && lua_isinteger(L, -1) && lua_tointeger(L, -1) == 9007199254740993ll,
+               "lua_any_t integers are read back exactly");
+        lua_pop(L, 1);
+
+        const char* file_name = "lua_bender_check.bin";
+        std::FILE* file = std::fopen(file_name, "wb");
+        if( file != nullptr ){
+            std::fclose(file);
+            file = std::fopen(file_name, "rb");
+            file_sink read_only{ file };
+            expect(!binary_writer<file_sink>(read_only).write(results[2]), "binary_writer reports the failed writes of a file_sink");
+            std::fclose(file);
+            std::remove(file_name);
+        }
+        lua_close(L);
+    }
+
+    inline void check_transfer(){
+        lua_class_metatable<test_point> point_metatable({
+            {"new",  lua_class_metatable<test_point>::create_instance<>},
+            {"__gc", lua_class_metatable<test_point>::destroy_instance}
+        });
+        lua_library lib({&point_metatable}, {});
+
+        lua_State* from = luaL_newstate();
+        lua_State* to = luaL_newstate();
+        luaL_openlibs(from);
+        luaL_openlibs(to);
+        lib.bind(from);
+        lib.bind(to);
+
+        luaL_dostring(from, "local shared = {1}\n"
+                            "local t = {1, 2.5, 'text', shared, shared = shared, point = test_point.new(), f = print}\n"
+                            "t.self = t\n"
+                            "return t");
+        expect(transfer_value(from, -1, to), "transfer_value copies tables, bound user data and C functions");
+        lua_setglobal(to, "copy");
+        lua_pop(from, 1);
+        expect_script(to, "assert(copy[1] == 1 and copy[2] == 2.5 and copy[3] == 'text' and copy.f == print)\n"
+                          "assert(copy.self == copy and copy.shared == copy[4] and copy[4][1] == 1)\n"
+                          "assert(getmetatable(copy.point) == test_point)");
+
+        value<const std::shared_ptr<test_point>&>::push(from, std::make_shared<test_point>());
+        expect(!transfer_value(from, -1, to) && lua_isnil(to, -1), "transfer_value refuses the user data owned by a smart pointer");
+        lua_pop(from, 1);
+        lua_pop(to, 1);
+
+        luaL_dostring(from, "local deep = {}\n"
+                            "for i = 1, 250 do deep = {deep} end\n"
+                            "return deep, function() end");
+        expect(!transfer_value(from, 1, to), "transfer_value refuses the values nested too deep");
+        expect(!transfer_value(from, 2, to) && lua_isnil(to, -1), "transfer_value refuses the Lua functions");
+        lua_settop(from, 0);
+        lua_settop(to, 0);
+
+        lua_close(from);
+
+        lua_State* worker = luaL_newstate();
+        luaL_openlibs(worker);
+        test_lib->bind(worker);
+        test_lib->bind(to);
+        luaL_dostring(worker, "local object = test_struct.new()\n"
+                              "object:set_int_value(7)\n"
+                              "return object, object");
+        expect(!transfer_value(worker, -1, to, false) && lua_isnil(to, -1), "transfer_value refuses the user data the source keeps owning");
+        lua_pop(to, 1);
+        lua_newtable(worker);
+        lua_pushvalue(worker, 1);
+        lua_rawseti(worker, -2, 1);
+        lua_pushvalue(worker, 2);
+        lua_rawseti(worker, -2, 2);
+        expect(transfer_value(worker, -1, to), "transfer_value moves the ownership of the collected user data");
+        lua_setglobal(to, "copies");
+        lua_close(worker);
+        expect_script(to, "assert(copies[1] == copies[2])\n"
+                          "assert(copies[1]:get_int_value() == 7)\n"
+                          "copies = nil\n"
+                          "collectgarbage()");
+        lua_close(to);
+    }
+
+    inline void check_script_cache(){
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+
+        compiled_script increment = compiled_script::load(L, "counter = (counter or 0) + 1");
+        expect(increment.valid() && increment.run(L) && increment.run(L), "compiled_script runs a chunk several times");
+        expect(!compiled_script::load(L, "this is not lua").valid(), "compiled_script reports syntax errors");
+
+        script_cache& cache = script_cache::get(L);
+        expect(&cache == &script_cache::get(L), "script_cache is created once per state");
+        const char* code = "counter = counter + 1";
+        for(int i = 0; i < 3; ++i){
+            script::do_string(L, code);
+        }
+        lua_getglobal(L, "counter");
+        expect(lua_tointeger(L, -1) == 5, "do_string runs the cached chunk");
+        lua_pop(L, 1);
+        expect(cache.m_misses == 1 && cache.m_hits == 2 && cache.m_entries.size() == 1, "do_string compiles the same code once");
+
+        expect(cache.push(L, code, strlen(code), "=other"), "script_cache::push compiles the chunk");
+        lua_pop(L, 1);
+        expect(cache.m_misses == 2 && cache.m_entries.size() == 1, "script_cache tells chunk names apart");
+        script::do_string(L, code);
+        // Another source under the same key stands for a hash collision.
+        cache.m_entries.front().m_source[0] = 'x';
+        script::do_string(L, code);
+        expect(cache.m_misses == 4 && cache.m_hits == 2, "script_cache compares the whole source, not only its hash");
+
+        cache.set_capacity(L, 2);
+        script::do_string(L, "return 1");
+        script::do_string(L, "return 2");
+        script::do_string(L, "return 3");
+        lua_settop(L, 0);
+        expect(cache.m_entries.size() == 2, "script_cache evicts the least recently used chunks");
+        cache.clear(L);
+        expect(cache.m_entries.empty() && cache.m_index.empty(), "script_cache::clear releases every chunk");
+
+        increment.m_chunk.release();
+        lua_close(L);
+    }
+
+    inline void check_bytecode_cache(){
+        const char* code = "return 'from bytecode'";
+        std::uint64_t key = bytecode_cache::key(code, strlen(code), code);
+        std::string file = bytecode_cache::path(".", key);
+
+        lua_State* L  = luaL_newstate();
+        luaL_openlibs(L);
+        script_cache::get(L).set_bytecode_directory(".");
+        script::do_string(L, code);
+        expect(lua_gettop(L) == 1 && std::string(lua_tostring(L, -1)) == "from bytecode", "do_string compiles and dumps the chunk");
+        lua_close(L);
+
+        L = luaL_newstate();
+        luaL_openlibs(L);
+        script_cache& cache = script_cache::get(L);
+        cache.set_bytecode_directory(".");
+        script::do_string(L, code);
+        expect(cache.m_bytecode_hits == 1 && lua_gettop(L) == 1 && std::string(lua_tostring(L, -1)) == "from bytecode",
+               "a new state loads the dumped chunk");
+        lua_settop(L, 0);
+
+        // A dump whose second hash does not match the source is ignored.
+        std::FILE* dump = std::fopen(file.c_str(), "r+b");
+        if( dump != nullptr ){
+            std::uint64_t check = 0;
+            std::fseek(dump, long(offsetof(bytecode_cache::header, m_check)), SEEK_SET);
+            std::fwrite(&check, sizeof(check), 1, dump);
+            std::fclose(dump);
+        }
+        cache.clear(L);
+        script::do_string(L, code);
+        expect(cache.m_bytecode_hits == 1 && lua_gettop(L) == 1, "a dump with another check hash is compiled again");
+        lua_settop(L, 0);
+        cache.clear(L);
+        script::do_string(L, code);
+        expect(cache.m_bytecode_hits == 2, "the dump is rewritten once compiled again");
+        lua_close(L);
+
+        expect(bytecode_cache::temporary_path(file) != bytecode_cache::temporary_path(file), "every dump goes through its own temporary file");
+        std::remove(file.c_str());
+    }
+
+    inline void check_mapped_files(){
+        const char* file_name = "lua_bender_check.lua";
+        std::FILE* file = std::fopen(file_name, "wb");
+        if( file == nullptr ){
+            expect(false, "the mapped file check could not write its script");
+            return;
+        }
+        const char content[] = "\xEF\xBB\xBF#!/usr/bin/lua\nreturn debug.getinfo(1, 'l').currentline, ...";
+        std::fwrite(content, 1, sizeof(content) - 1, file);
+        std::fclose(file);
+
+        // The file is removed once unmapped, which Windows requires.
+        {
+            mapped_file mapped(file_name);
+            expect(mapped.valid() && mapped.m_size == sizeof(content) - 1, "mapped_file maps the whole file");
+            expect(mapped.chunk()[0] == '\n', "mapped_file skips the BOM and the first # line but keeps its line break");
+
+            lua_State* L  = luaL_newstate();
+            luaL_openlibs(L);
+            expect(mapped.load(L, "@lua_bender_check.lua") == LUA_OK && lua_pcall(L, 0, 1, 0) == LUA_OK && lua_tointeger(L, -1) == 2,
+                   "mapped_file::load keeps the line numbers as luaL_loadfile");
+            lua_settop(L, 0);
+            script::do_file(L, file_name);
+            script::do_file(L, file_name);
+            expect(lua_gettop(L) == 2 && script_cache::get(L).m_hits == 1, "do_file compiles the mapped file once");
+            lua_settop(L, 0);
+
+            mapped_file missing("lua_bender_missing.lua");
+            expect(!missing.valid() && missing.load(L, "@lua_bender_missing.lua") == LUA_ERRFILE, "mapped_file reports missing files");
+            lua_settop(L, 0);
+            lua_close(L);
+        }
+        std::remove(file_name);
+    }
+
+    /** @brief Run all the behavior checks and return the number of failures. */
+    inline int launch_checks(){
+        check_failures() = 0;
+        check_lazy_binding();
+        check_modules();
+        check_dynamic_fields();
+        check_enums();
+        check_smart_pointers();
+        check_sequences();
+        check_views();
+        check_associative_containers();
+        check_numeric_arrays();
+        check_struct_tables();
+        check_optional_variant();
+        check_batch_functions();
+        check_columns();
+        check_string_builder();
+        check_iterators();
+        check_any_values();
+        check_any_tables();
+        check_visitors();
+        check_typed_results();
+        check_references();
+        check_serialization();
+        check_transfer();
+        check_script_cache();
+        check_bytecode_cache();
+        check_mapped_files();
+        std::cout << "Behavior checks failed: " << check_failures() << std::endl;
+        return check_failures();
+    }
+
     inline void launch_test(){
         // Creating the execution context.
         lua_State* L  = luaL_newstate();
@@ -201,12 +1236,43 @@ namespace lua_bender{
         std::cout << "Printing the results of the scripts" << std::endl;
         for(const lua_any_t& val : res){
             val.log_type_name();
-            if( val.m_lua_type == LUA_TUSERDATA ){
-                test_struct* data = static_cast<test_struct*>(val.m_udata);
+            if( test_struct* data = val.get<test_struct*>() ){
                 LUA_BENDER_LOG_INFO("test_struct : (\"%s\", %d, %f, %f)", data->get_str_value().c_str(), data->get_int_value(), data->get_number_value(), data->m_double_value);
                 delete data;
             }
         }
+
+        launch_checks();
+    }
+
+    /** @brief Compare the compilation of a file through luaL_loadfile and through a memory mapping. */
+    inline void launch_file_loading_benchmark(const char* file, int iterations = 100){
+        lua_State* L  = luaL_newstate();
+        std::string chunk_name = std::string("@") + file;
+
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; ++i){
+            if( luaL_loadfile(L, file) != LUA_OK ){
+                LUA_BENDER_LOG_ERROR("%s", lua_tostring(L, -1));
+            }
+            lua_pop(L, 1);
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; ++i){
+            if( mapped_file(file).load(L, chunk_name.c_str()) != LUA_OK ){
+                LUA_BENDER_LOG_ERROR("%s", lua_tostring(L, -1));
+            }
+            lua_pop(L, 1);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        lua_close(L);
+
+        std::chrono::duration<double, std::milli> file_time = middle - start;
+        std::chrono::duration<double, std::milli> mapped_time = end - middle;
+        std::cout << "Loading " << file << " " << iterations << " times" << std::endl;
+        std::cout << "luaL_loadfile : " << file_time.count() << " ms" << std::endl;
+        std::cout << "mapped_file   : " << mapped_time.count() << " ms" << std::endl;
     }
 }
 
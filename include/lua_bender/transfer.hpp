@@ -0,0 +1,237 @@
+#ifndef LUA_BENDER_TRANSFER_HPP
+#define LUA_BENDER_TRANSFER_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "any.hpp"
+#include "user_data.hpp"
+
+
+// This file copies values from a lua_State to another independent one in a single native pass, e.g. between workers.
+// Tables are rebuilt with presized lua_createtable, keeping shared tables and cycles, but not their metatables.
+// User data of the bound classes are wrapped again with the metatable of the same name in the target state,
+// the target taking over the objects collected by the source, and C functions without upvalues are copied as is.
+// Lua functions, threads and the other user data cannot be copied, nor the user data owned by a smart pointer
+// (see holder_user_data), whose data would not outlive the source state.
+// As the binary serialization, values nested deeper than 200 levels are refused.
+//
+// lua_bender::transfer_value(worker, -1, main);
+
+namespace lua_bender{
+    struct state_transfer{
+        static constexpr int s_max_depth = 200;
+
+        lua_State* m_from;
+        lua_State* m_to;
+        // Source tables and user data indexed by their position, and target values at these positions.
+        int        m_from_visited;
+        int        m_to_visited;
+        int        m_visited_count;
+        bool       m_transfer_ownership;
+        bool       m_failed;
+
+        state_transfer(lua_State* from, lua_State* to, bool transfer_ownership):
+            m_from(from), m_to(to), m_from_visited(), m_to_visited(), m_visited_count(), m_transfer_ownership(transfer_ownership), m_failed(){}
+
+        void fail(const char* type_name){
+            LUA_BENDER_LOG_ERROR("lua_bender::transfer_value cannot copy a %s value", type_name);
+            m_failed = true;
+            lua_pushnil(m_to);
+        }
+
+        /** @brief Push on the target state a copy of the value at the given index of the source state. */
+        void copy(int index, int depth){
+            if( depth > s_max_depth ){
+                LUA_BENDER_LOG_ERROR("lua_bender::transfer_value cannot copy values nested deeper than %d levels", s_max_depth);
+                m_failed = true;
+                lua_pushnil(m_to);
+                return;
+            }
+            luaL_checkstack(m_to, 4, "lua_bender::state_transfer");
+            index = lua_absindex(m_from, index);
+            int type = lua_type(m_from, index);
+            switch( type ){
+                case LUA_TNIL:
+                case LUA_TNONE:
+                    lua_pushnil(m_to);
+                    break;
+                case LUA_TBOOLEAN:
+                    lua_pushboolean(m_to, lua_toboolean(m_from, index));
+                    break;
+                case LUA_TNUMBER:
+                    if( lua_isinteger(m_from, index) ){
+                        lua_pushinteger(m_to, lua_tointeger(m_from, index));
+                    }
+                    else{
+                        lua_pushnumber(m_to, lua_tonumber(m_from, index));
+                    }
+                    break;
+                case LUA_TSTRING:{
+                    size_t length = 0;
+                    const char* str = lua_tolstring(m_from, index, &length);
+                    lua_pushlstring(m_to, str, length);
+                    break;
+                }
+                case LUA_TLIGHTUSERDATA:
+                    lua_pushlightuserdata(m_to, lua_touserdata(m_from, index));
+                    break;
+                case LUA_TTABLE:
+                    if( !push_visited(index) ){
+                        copy_table(index, depth);
+                    }
+                    break;
+                case LUA_TUSERDATA:
+                    if( !push_visited(index) ){
+                        copy_user_data(index);
+                    }
+                    break;
+                case LUA_TFUNCTION:
+                    if( lua_iscfunction(m_from, index) ){
+                        if( lua_getupvalue(m_from, index, 1) == nullptr ){
+                            lua_pushcfunction(m_to, lua_tocfunction(m_from, index));
+                            break;
+                        }
+                        lua_pop(m_from, 1);
+                    }
+                    fail("Lua function or C closure");
+                    break;
+                default:
+                    fail(lua_typename(m_from, type));
+                    break;
+            }
+        }
+
+        /** @brief Push the copy of a table or user data already reached, return false if there is none. */
+        bool push_visited(int index){
+            luaL_checkstack(m_from, 4, "lua_bender::state_transfer");
+            lua_pushvalue(m_from, index);
+            if( lua_rawget(m_from, m_from_visited) == LUA_TNUMBER ){
+                lua_rawgeti(m_to, m_to_visited, lua_tointeger(m_from, -1));
+                lua_pop(m_from, 1);
+                return true;
+            }
+            lua_pop(m_from, 1);
+            return false;
+        }
+
+        /** @brief Record the copy on top of the target stack, so the next references to the source value share it. */
+        void set_visited(int index){
+            lua_pushvalue(m_to, -1);
+            lua_rawseti(m_to, m_to_visited, ++m_visited_count);
+            lua_pushvalue(m_from, index);
+            lua_pushinteger(m_from, m_visited_count);
+            lua_rawset(m_from, m_from_visited);
+        }
+
+        void copy_table(int index, int depth){
+            lua_Integer array_size = lua_Integer(lua_rawlen(m_from, index));
+            int hash_size = 0;
+            lua_pushnil(m_from);
+            while( lua_next(m_from, index) ){
+                lua_pop(m_from, 1);
+                hash_size += is_array_key(m_from, -1, array_size) ? 0 : 1;
+            }
+
+            lua_createtable(m_to, int(array_size), hash_size);
+            set_visited(index);
+
+            for(lua_Integer i = 1; i <= array_size; ++i){
+                lua_rawgeti(m_from, index, i);
+                copy(-1, depth + 1);
+                lua_rawseti(m_to, -2, i);
+                lua_pop(m_from, 1);
+            }
+            lua_pushnil(m_from);
+            while( lua_next(m_from, index) ){
+                if( !is_array_key(m_from, -2, array_size) ){
+                    copy(-2, depth + 1);
+                    copy(-1, depth + 1);
+                    if( lua_isnil(m_to, -2) ){
+                        lua_pop(m_to, 2);
+                    }
+                    else{
+                        lua_rawset(m_to, -3);
+                    }
+                }
+                lua_pop(m_from, 1);
+            }
+        }
+
+        /** @brief Wrap the data again, only for user data whose metatable is registered under its __name in both states. */
+        void copy_user_data(int index){
+            if( !lua_getmetatable(m_from, index) ){
+                fail("user data without metatable");
+                return;
+            }
+            bool is_bound = false;
+            if( lua_getfield(m_from, -1, "__name") == LUA_TSTRING ){
+                luaL_getmetatable(m_from, lua_tostring(m_from, -1));
+                is_bound = lua_rawequal(m_from, -1, -3);
+                lua_pop(m_from, 1);
+            }
+            if( !is_bound ){
+                lua_pop(m_from, 2);
+                fail("user data of an unbound type");
+                return;
+            }
+
+            const char* type_name = lua_tostring(m_from, -1);
+            if( user_data::get_metatable(m_to, type_name) != LUA_TTABLE ){
+                lua_pop(m_from, 2);
+                lua_pop(m_to, 1);
+                fail(type_name);
+                return;
+            }
+            lua_pop(m_to, 1);
+
+            user_data* udata = user_data::check(m_from, index);
+            if( udata == nullptr || udata->m_data == nullptr ){
+                lua_pop(m_from, 2);
+                fail("empty user data");
+                return;
+            }
+            // The smart pointer stays in the source block, a plain pointer to its data would dangle once it is collected.
+            if( udata->m_release != nullptr ){
+                lua_pop(m_from, 2);
+                fail("user data owned by a smart pointer");
+                return;
+            }
+            // Likewise if the source keeps collecting the data, which would be deleted with the source state.
+            if( udata->m_garbage_collected && !m_transfer_ownership ){
+                lua_pop(m_from, 2);
+                fail("user data owned by the source state");
+                return;
+            }
+            bool owned = udata->m_garbage_collected;
+            udata->m_garbage_collected = false;
+            user_data::push(m_to, udata->m_data, type_name, owned);
+            lua_pop(m_from, 2);
+            set_visited(index);
+        }
+    };
+
+    /**
+     * @brief Push on the target state a deep copy of the value at the given index of the source state.
+     * The data of the user data are shared by both states. The target takes over the data collected by the source,
+     * which must then not be used once the target state is closed; without transfer_ownership these user data are refused,
+     * as the user data owned by a smart pointer. The data owned by C++ are shared without any ownership.
+     * Return false if some values could not be copied, which are replaced by nil.
+     */
+    inline bool transfer_value(lua_State* from, int index, lua_State* to, bool transfer_ownership = true){
+        index = lua_absindex(from, index);
+        state_transfer transfer(from, to, transfer_ownership);
+        luaL_checkstack(from, 2, "lua_bender::transfer_value");
+        luaL_checkstack(to, 2, "lua_bender::transfer_value");
+        lua_newtable(from);
+        transfer.m_from_visited = lua_gettop(from);
+        lua_newtable(to);
+        transfer.m_to_visited = lua_gettop(to);
+
+        transfer.copy(index, 0);
+        lua_remove(to, transfer.m_to_visited);
+        lua_pop(from, 1);
+        return !transfer.m_failed;
+    }
+}
+
+#endif
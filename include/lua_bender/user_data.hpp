@@ -3,15 +3,22 @@
 #pragma once
 
 #include "basis.hpp"
+#include <cstddef>
+#include <utility>
 
 #define lua_bender_register_user_data_name(type, name)\
     template<> std::string lua_bender::user_data_type_name<type>::s_name = name
 
+// Registry field holding the loaders of the metatables bound lazily (see lua_library::bind_lazy).
+#define LUA_BENDER_LAZY_METATABLES "lua_bender.lazy_metatables"
+
 
 namespace lua_bender{
     struct user_data{
         void*       m_data;
         bool        m_garbage_collected;
+        // Set when the user data owns its data through a smart pointer stored inline (see holder_user_data).
+        void        (*m_release)(void* block);
 
         static inline void push(lua_State* L, void* data, const char* type_name, bool garbage_collected = false){
             user_data** udata = (user_data**)lua_newuserdata(L, sizeof(user_data*));
@@ -19,7 +26,7 @@ namespace lua_bender{
             (*udata)->m_data = data;
             (*udata)->m_garbage_collected = garbage_collected;
 
-            luaL_getmetatable(L, type_name);
+            get_metatable(L, type_name);
             lua_setmetatable(L, -2);
         }
 
@@ -33,12 +40,84 @@ namespace lua_bender{
         static inline user_data* check(lua_State* L, int index){
             return *(user_data**)lua_touserdata(L, index);
         }
+
+        /** @brief Push a user data storing the given smart pointer inline, released by the class destroy_instance. */
+        template<class Holder>
+        static inline void push_holder(lua_State* L, Holder&& holder, const char* type_name);
+
+        /** @brief Push the metatable of the given type name, materializing it first if it was bound lazily. */
+        static inline int get_metatable(lua_State* L, const char* type_name){
+            int type = luaL_getmetatable(L, type_name);
+            if( type != LUA_TNIL ){
+                return type;
+            }
+            lua_pop(L, 1);
+
+            // A lazily bound type only has a loader stub until its first use.
+            if( lua_getfield(L, LUA_REGISTRYINDEX, LUA_BENDER_LAZY_METATABLES) == LUA_TTABLE ){
+                if( lua_getfield(L, -1, type_name) == LUA_TFUNCTION ){
+                    lua_call(L, 0, 0);
+                }
+                else{
+                    lua_pop(L, 1);
+                }
+            }
+            lua_pop(L, 1);
+
+            return luaL_getmetatable(L, type_name);
+        }
     };
 
     template<class C>
     struct user_data_type_name{ static std::string s_name; };
 
 
+    /**
+     * @brief Layout of a user data owning its data through a smart pointer.
+     * The user_data header and the smart pointer share the single Lua allocation, and the first field keeps
+     * the user_data** layout expected by user_data::check and the member function adapters.
+     */
+    template<class Holder>
+    struct holder_user_data{
+        user_data* m_header;
+        user_data  m_udata;
+        Holder     m_holder;
+
+        static void release(void* block){
+            holder_user_data* self = static_cast<holder_user_data*>(block);
+            self->m_header = nullptr;
+            self->~holder_user_data();
+        }
+
+        /** @brief Return the holder of the user data at the given index if it stores a Holder, null otherwise. */
+        static holder_user_data* test(lua_State* L, int index){
+            if( lua_type(L, index) != LUA_TUSERDATA ){
+                return nullptr;
+            }
+            user_data* udata = user_data::check(L, index);
+            if( udata == nullptr || udata->m_release != &release ){
+                return nullptr;
+            }
+            return static_cast<holder_user_data*>(lua_touserdata(L, index));
+        }
+    };
+
+    template<class Holder>
+    inline void user_data::push_holder(lua_State* L, Holder&& holder, const char* type_name){
+        typedef holder_user_data<typename std::decay<Holder>::type> block_type;
+        block_type* block = static_cast<block_type*>(lua_newuserdata(L, sizeof(block_type)));
+        new (&block->m_udata) user_data();
+        new (&block->m_holder) typename std::decay<Holder>::type(std::forward<Holder>(holder));
+        block->m_header = &block->m_udata;
+        block->m_udata.m_data = block->m_holder.get();
+        block->m_udata.m_garbage_collected = false;
+        block->m_udata.m_release = &block_type::release;
+
+        get_metatable(L, type_name);
+        lua_setmetatable(L, -2);
+    }
+
+
     template<class C>
     struct value<C&>{
         static C& check(lua_State* L, int index){
@@ -52,15 +131,86 @@ namespace lua_bender{
         }
     };
 
+    /** @brief Specialized by lua_bender_register_struct_fields for the structures exchanged as tables (see struct_table.hpp). */
     template<class C>
-    struct value<const C&>{
-        static C& check(lua_State* L, int index){
-            user_data* udata = user_data::check(L, index);
-            return *((C*)udata->m_data);
+    struct struct_fields{
+        static constexpr bool s_registered = false;
+    };
+
+    /** @brief Structures with registered fields are read from and pushed as tables instead of user data. */
+    template<class C>
+    struct struct_value{
+        static C check(lua_State* L, int index){
+            C res;
+            struct_fields<C>::check(L, index, res);
+            return res;
         }
 
-        static int push(lua_State* L, C& value){
-            user_data::push(L, &value, user_data_type_name<C>::s_name.c_str(), false);
+        static int push(lua_State* L, const C& value){
+            return struct_fields<C>::push(L, value);
+        }
+    };
+
+    template<class C>
+    struct value<const C&> : std::conditional<std::is_enum<C>::value, enum_value<C>,
+                             typename std::conditional<struct_fields<C>::s_registered, struct_value<C>, value<C&>>::type>::type{};
+
+
+    // Smart pointers are stored inline in the user data and released by the __gc of the class metatable
+    // (lua_class_metatable::destroy_instance), which must thus be registered for these types.
+    template<class C>
+    struct value<const std::shared_ptr<C>&>{
+        static std::shared_ptr<C> check(lua_State* L, int index){
+            holder_user_data<std::shared_ptr<C>>* block = holder_user_data<std::shared_ptr<C>>::test(L, index);
+            if( block == nullptr ){
+                LUA_BENDER_LOG_ERROR("lua_bender::value<std::shared_ptr> the user data is not owned by a shared_ptr");
+                return std::shared_ptr<C>();
+            }
+            return block->m_holder;
+        }
+
+        static int push(lua_State* L, const std::shared_ptr<C>& value){
+            if( value == nullptr ){
+                lua_pushnil(L);
+                return 1;
+            }
+            user_data::push_holder(L, std::shared_ptr<C>(value), user_data_type_name<C>::s_name.c_str());
+            return 1;
+        }
+    };
+
+    // Reading a unique_ptr moves the ownership out of Lua, the user data is then left empty.
+    // User data created with lua_class_metatable::create_instance can be taken over the same way.
+    template<class C>
+    struct value<const std::unique_ptr<C>&>{
+        static std::unique_ptr<C> check(lua_State* L, int index){
+            std::unique_ptr<C> res;
+            user_data* udata = lua_type(L, index) == LUA_TUSERDATA ? user_data::check(L, index) : nullptr;
+            holder_user_data<std::unique_ptr<C>>* block = holder_user_data<std::unique_ptr<C>>::test(L, index);
+            if( block != nullptr ){
+                res = std::move(block->m_holder);
+            }
+            else if( udata != nullptr && udata->m_release == nullptr && udata->m_garbage_collected ){
+                res.reset(static_cast<C*>(udata->m_data));
+                udata->m_garbage_collected = false;
+            }
+            else{
+                LUA_BENDER_LOG_ERROR("lua_bender::value<std::unique_ptr> the user data ownership cannot be transfered");
+                return res;
+            }
+
+            if( udata != nullptr ){
+                udata->m_data = nullptr;
+            }
+            return res;
+        }
+
+        static int push(lua_State* L, std::unique_ptr<C> value){
+            if( value == nullptr ){
+                lua_pushnil(L);
+                return 1;
+            }
+            user_data::push_holder(L, std::move(value), user_data_type_name<C>::s_name.c_str());
             return 1;
         }
     };
@@ -68,7 +218,11 @@ namespace lua_bender{
 
     template<class C>
     struct value<C* const&>{
+        /** @brief Nil, as any value which is not a user data, is read as a null pointer. */
         static C* check(lua_State* L, int index){
+            if( lua_type(L, index) != LUA_TUSERDATA ){
+                return nullptr;
+            }
             user_data* udata = user_data::check(L, index);
             if( udata != nullptr ){
                 return (C*)udata->m_data;
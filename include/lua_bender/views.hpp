@@ -0,0 +1,339 @@
+#ifndef LUA_BENDER_VIEWS_HPP
+#define LUA_BENDER_VIEWS_HPP
+#pragma once
+
+#include "basis.hpp"
+#include "containers.hpp"
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Views expose a C++ container to Lua in place, without copying it into a table.
+// A view is a small user data holding a pointer to the container, with the __index, __newindex, __len, __pairs and __ipairs
+// metamethods implemented natively and converting one element at a time with the value template.
+//
+// Views never own the container, which must outlive every use of the view from Lua.
+// Returning a view from a bound function is enough to push it:
+//
+// lua_bender::vector_view<float> get_samples(){ return lua_bender::vector_view<float>(engine_samples); }
+
+namespace lua_bender{
+    /** @brief Fixed size view over contiguous elements (a vector, an array or a pointer and a size). */
+    template<typename T>
+    struct array_view{
+        T*          m_data;
+        std::size_t m_size;
+
+        array_view(): m_data(), m_size(){}
+        array_view(T* data, std::size_t size): m_data(data), m_size(size){}
+        array_view(std::vector<T>& values): m_data(values.data()), m_size(values.size()){}
+
+        template<std::size_t N>
+        array_view(std::array<T, N>& values): m_data(values.data()), m_size(N){}
+
+        std::size_t size() const{ return m_size; }
+        T& operator[](std::size_t i) const{ return m_data[i]; }
+    };
+
+    /** @brief View over a std::vector, which can also grow by assigning the element following the last one. */
+    template<typename T>
+    struct vector_view{
+        std::vector<T>* m_vector;
+
+        vector_view(): m_vector(){}
+        vector_view(std::vector<T>& values): m_vector(&values){}
+
+        std::size_t size() const{ return m_vector->size(); }
+        // The reference type is a proxy for std::vector<bool>.
+        typename std::vector<T>::reference operator[](std::size_t i) const{ return (*m_vector)[i]; }
+    };
+
+    /**
+     * @brief View over a std::unordered_map, assigning nil to a key erases it.
+     * Unlike a Lua table the entry is erased at once, so entries cannot be cleared while iterating with pairs,
+     * the next step failing with "invalid key to 'next'": collect the keys to erase first.
+     */
+    template<typename K, typename V>
+    struct unordered_map_view{
+        std::unordered_map<K, V>* m_map;
+
+        unordered_map_view(): m_map(){}
+        unordered_map_view(std::unordered_map<K, V>& values): m_map(&values){}
+    };
+
+
+    /** @brief Common user data management of the views, with one metatable per view type created on first use. */
+    template<class View>
+    struct view_user_data{
+        // Only the address matters, used as registry key of the metatable.
+        static inline const char s_metatable_key = 0;
+
+        static void push(lua_State* L, const View& view){
+            View* udata = static_cast<View*>(lua_newuserdata(L, sizeof(View)));
+            new (udata) View(view);
+
+            if( lua_rawgetp(L, LUA_REGISTRYINDEX, &s_metatable_key) == LUA_TNIL ){
+                lua_pop(L, 1);
+                lua_createtable(L, 0, 6);
+                set_view_metamethods(L, static_cast<View*>(nullptr));
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, LUA_REGISTRYINDEX, &s_metatable_key);
+            }
+            lua_setmetatable(L, -2);
+        }
+
+        /** @brief Return the view at the given index, or null if the value is not a View. */
+        static View* test(lua_State* L, int index){
+            View* udata = static_cast<View*>(lua_touserdata(L, index));
+            if( udata == nullptr || !lua_getmetatable(L, index) ){
+                return nullptr;
+            }
+            lua_rawgetp(L, LUA_REGISTRYINDEX, &s_metatable_key);
+            bool is_view = lua_rawequal(L, -1, -2);
+            lua_pop(L, 2);
+            return is_view ? udata : nullptr;
+        }
+
+        static View& check(lua_State* L, int index){
+            View* view = test(L, index);
+            if( view == nullptr ){
+                luaL_argerror(L, index, "lua_bender view expected");
+            }
+            return *view;
+        }
+    };
+
+
+    /** @brief Metamethods shared by the sequence views, elements are accessed with indices starting at 1. */
+    template<class View, typename T>
+    struct sequence_view_metamethods{
+        static int index(lua_State* L){
+            View& view = view_user_data<View>::check(L, 1);
+            int is_integer = 0;
+            lua_Integer i = lua_tointegerx(L, 2, &is_integer);
+            if( !is_integer || i < 1 || std::size_t(i) > view.size() ){
+                lua_pushnil(L);
+                return 1;
+            }
+            sequence_element<T>::push(L, view[std::size_t(i - 1)]);
+            return 1;
+        }
+
+        static int len(lua_State* L){
+            lua_pushinteger(L, lua_Integer(view_user_data<View>::check(L, 1).size()));
+            return 1;
+        }
+
+        /** @brief Stateless iterator, the control variable is the index of the previous element. */
+        static int next(lua_State* L){
+            View& view = view_user_data<View>::check(L, 1);
+            lua_Integer i = luaL_checkinteger(L, 2) + 1;
+            if( std::size_t(i) > view.size() ){
+                return 0;
+            }
+            lua_pushinteger(L, i);
+            sequence_element<T>::push(L, view[std::size_t(i - 1)]);
+            return 2;
+        }
+
+        static int pairs(lua_State* L){
+            lua_pushcfunction(L, next);
+            lua_pushvalue(L, 1);
+            lua_pushinteger(L, 0);
+            return 3;
+        }
+
+        static void set_metamethods(lua_State* L, lua_CFunction newindex, const char* name){
+            const luaL_Reg metamethods[] = {
+                {"__index",    index},
+                {"__newindex", newindex},
+                {"__len",      len},
+                {"__pairs",    pairs},
+                {"__ipairs",   pairs},
+                {nullptr, nullptr}
+            };
+            luaL_setfuncs(L, metamethods, 0);
+            lua_pushstring(L, name);
+            lua_setfield(L, -2, "__name");
+        }
+    };
+
+
+    template<typename T>
+    struct value<const array_view<T>&>{
+        static array_view<T> check(lua_State* L, int index){ return view_user_data< array_view<T> >::check(L, index); }
+
+        static int push(lua_State* L, const array_view<T>& value){
+            view_user_data< array_view<T> >::push(L, value);
+            return 1;
+        }
+    };
+
+    template<typename T>
+    struct value<const vector_view<T>&>{
+        static vector_view<T> check(lua_State* L, int index){ return view_user_data< vector_view<T> >::check(L, index); }
+
+        static int push(lua_State* L, const vector_view<T>& value){
+            view_user_data< vector_view<T> >::push(L, value);
+            return 1;
+        }
+    };
+
+    template<typename K, typename V>
+    struct value<const unordered_map_view<K, V>&>{
+        static unordered_map_view<K, V> check(lua_State* L, int index){ return view_user_data< unordered_map_view<K, V> >::check(L, index); }
+
+        static int push(lua_State* L, const unordered_map_view<K, V>& value){
+            view_user_data< unordered_map_view<K, V> >::push(L, value);
+            return 1;
+        }
+    };
+
+
+    // ******************************** METAMETHODS ********************************
+
+    template<typename T>
+    struct array_view_metamethods : sequence_view_metamethods<array_view<T>, T>{
+        static int newindex(lua_State* L){
+            array_view<T>& view = view_user_data< array_view<T> >::check(L, 1);
+            lua_Integer i = luaL_checkinteger(L, 2);
+            luaL_argcheck(L, i >= 1 && std::size_t(i) <= view.size(), 2, "index out of range");
+            view[std::size_t(i - 1)] = sequence_element<T>::check_at(L, 3);
+            return 0;
+        }
+    };
+
+    template<typename T>
+    struct vector_view_metamethods : sequence_view_metamethods<vector_view<T>, T>{
+        static int newindex(lua_State* L){
+            vector_view<T>& view = view_user_data< vector_view<T> >::check(L, 1);
+            lua_Integer i = luaL_checkinteger(L, 2);
+            luaL_argcheck(L, i >= 1 && std::size_t(i) <= view.size() + 1, 2, "index out of range");
+            if( std::size_t(i) == view.size() + 1 ){
+                view.m_vector->push_back(sequence_element<T>::check_at(L, 3));
+            }
+            else{
+                view[std::size_t(i - 1)] = sequence_element<T>::check_at(L, 3);
+            }
+            return 0;
+        }
+    };
+
+    template<typename K, typename V>
+    struct unordered_map_view_metamethods{
+        typedef unordered_map_view<K, V> view_type;
+
+        /** @brief Tell whether the value at the given index can be read as a key, without raising an error. */
+        static bool is_key(lua_State* L, int index){
+            if constexpr( std::is_same<K, bool>::value ){
+                return lua_type(L, index) == LUA_TBOOLEAN;
+            }
+            else if constexpr( std::is_integral<K>::value ){
+                int is_integer = 0;
+                lua_tointegerx(L, index, &is_integer);
+                return lua_type(L, index) == LUA_TNUMBER && is_integer;
+            }
+            else if constexpr( std::is_floating_point<K>::value ){
+                return lua_type(L, index) == LUA_TNUMBER;
+            }
+            else if constexpr( std::is_same<K, std::string>::value ){
+                return lua_type(L, index) == LUA_TSTRING || lua_type(L, index) == LUA_TNUMBER;
+            }
+            else{
+                return !lua_isnil(L, index);
+            }
+        }
+
+        static int index(lua_State* L){
+            view_type& view = view_user_data<view_type>::check(L, 1);
+            if( !is_key(L, 2) ){
+                lua_pushnil(L);
+                return 1;
+            }
+            auto entry = view.m_map->find(sequence_element<K>::check_at(L, 2));
+            if( entry == view.m_map->end() ){
+                lua_pushnil(L);
+                return 1;
+            }
+            sequence_element<V>::push(L, entry->second);
+            return 1;
+        }
+
+        static int newindex(lua_State* L){
+            view_type& view = view_user_data<view_type>::check(L, 1);
+            if( !is_key(L, 2) ){
+                return luaL_error(L, "invalid %s key for a map view", luaL_typename(L, 2));
+            }
+            if( lua_isnil(L, 3) ){
+                view.m_map->erase(sequence_element<K>::check_at(L, 2));
+            }
+            else{
+                (*view.m_map)[sequence_element<K>::check_at(L, 2)] = sequence_element<V>::check_at(L, 3);
+            }
+            return 0;
+        }
+
+        static int len(lua_State* L){
+            lua_pushinteger(L, lua_Integer(view_user_data<view_type>::check(L, 1).m_map->size()));
+            return 1;
+        }
+
+        /** @brief Iterator resuming from the previous key, found again in constant time. */
+        static int next(lua_State* L){
+            view_type& view = view_user_data<view_type>::check(L, 1);
+            auto entry = view.m_map->begin();
+            if( !lua_isnil(L, 2) ){
+                if( !is_key(L, 2) ){
+                    return luaL_error(L, "invalid key to 'next'");
+                }
+                entry = view.m_map->find(sequence_element<K>::check_at(L, 2));
+                if( entry == view.m_map->end() ){
+                    return luaL_error(L, "invalid key to 'next'");
+                }
+                ++entry;
+            }
+            if( entry == view.m_map->end() ){
+                return 0;
+            }
+            sequence_element<K>::push(L, entry->first);
+            sequence_element<V>::push(L, entry->second);
+            return 2;
+        }
+
+        static int pairs(lua_State* L){
+            lua_pushcfunction(L, next);
+            lua_pushvalue(L, 1);
+            lua_pushnil(L);
+            return 3;
+        }
+    };
+
+    template<typename T>
+    inline void set_view_metamethods(lua_State* L, array_view<T>*){
+        array_view_metamethods<T>::set_metamethods(L, array_view_metamethods<T>::newindex, "lua_bender.array_view");
+    }
+
+    template<typename T>
+    inline void set_view_metamethods(lua_State* L, vector_view<T>*){
+        vector_view_metamethods<T>::set_metamethods(L, vector_view_metamethods<T>::newindex, "lua_bender.vector_view");
+    }
+
+    template<typename K, typename V>
+    inline void set_view_metamethods(lua_State* L, unordered_map_view<K, V>*){
+        typedef unordered_map_view_metamethods<K, V> metamethods_type;
+        const luaL_Reg metamethods[] = {
+            {"__index",    metamethods_type::index},
+            {"__newindex", metamethods_type::newindex},
+            {"__len",      metamethods_type::len},
+            {"__pairs",    metamethods_type::pairs},
+            {nullptr, nullptr}
+        };
+        luaL_setfuncs(L, metamethods, 0);
+        lua_pushstring(L, "lua_bender.unordered_map_view");
+        lua_setfield(L, -2, "__name");
+    }
+}
+
+#endif
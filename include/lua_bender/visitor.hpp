@@ -0,0 +1,113 @@
+#ifndef LUA_BENDER_VISITOR_HPP
+#define LUA_BENDER_VISITOR_HPP
+#pragma once
+
+#include "basis.hpp"
+#include <cstddef>
+#include <string_view>
+
+
+// Visitors read script results in place, without any intermediate container nor heap allocation.
+// The visitor is called with the value converted to one of the following types, so a generic lambda or a set of overloads fits:
+//
+// std::nullptr_t      nil
+// bool                boolean
+// lua_Integer         integer number
+// lua_Number          float number
+// std::string_view    string, borrowed from Lua and valid while the value stays on the stack or in its table
+// lua_table_ref       table, to be walked with visit_table or visit_array
+// lua_stack_ref       any other value (user data, light user data, function, thread)
+//
+// lua_bender::visit_stack(L, 1, lua_gettop(L), [](auto value){ ... });
+
+namespace lua_bender{
+    /** @brief Stack slot of a table given to a visitor. */
+    struct lua_table_ref{
+        lua_State* m_state;
+        int        m_index;
+    };
+
+    /** @brief Stack slot of a value which has no direct C++ counterpart. */
+    struct lua_stack_ref{
+        lua_State* m_state;
+        int        m_index;
+        int        m_type;
+    };
+
+    /** @brief Call the visitor with the value located at the given index. */
+    template<typename Visitor>
+    inline void visit_value(lua_State* L, int index, Visitor&& visitor){
+        int type = lua_type(L, index);
+        switch( type ){
+            case LUA_TNONE:
+            case LUA_TNIL:
+                visitor(nullptr);
+                break;
+            case LUA_TBOOLEAN:
+                visitor(bool(lua_toboolean(L, index)));
+                break;
+            case LUA_TNUMBER:
+                if( lua_isinteger(L, index) ){
+                    visitor(lua_tointeger(L, index));
+                }
+                else{
+                    visitor(lua_tonumber(L, index));
+                }
+                break;
+            case LUA_TSTRING:{
+                size_t length = 0;
+                const char* str = lua_tolstring(L, index, &length);
+                visitor(std::string_view(str, length));
+                break;
+            }
+            case LUA_TTABLE:
+                visitor(lua_table_ref{ L, lua_absindex(L, index) });
+                break;
+            default:
+                visitor(lua_stack_ref{ L, lua_absindex(L, index), type });
+                break;
+        }
+    }
+
+    /** @brief Call the visitor with each value of the stack from first to last, e.g. the results of a script. */
+    template<typename Visitor>
+    inline void visit_stack(lua_State* L, int first, int last, Visitor&& visitor){
+        for(int i = first; i <= last; ++i){
+            visit_value(L, i, visitor);
+        }
+    }
+
+    /** @brief Call the visitor with the key and the value of each entry of the table located at the given index. */
+    template<typename Visitor>
+    inline void visit_table(lua_State* L, int index, Visitor&& visitor){
+        index = lua_absindex(L, index);
+        luaL_checkstack(L, 3, "lua_bender::visit_table");
+        lua_pushnil(L);
+        while( lua_next(L, index) ){
+            // Neither the key nor the value is converted in place, which keeps lua_next valid.
+            visit_value(L, -2, [&](auto key){
+                visit_value(L, -1, [&](auto value){
+                    visitor(key, value);
+                });
+            });
+            lua_pop(L, 1);
+        }
+    }
+
+    /** @brief Call the visitor with the position, from 1, and the value of each element of the array part 1..#t. */
+    template<typename Visitor>
+    inline void visit_array(lua_State* L, int index, Visitor&& visitor){
+        index = lua_absindex(L, index);
+        luaL_checkstack(L, 2, "lua_bender::visit_array");
+        lua_Integer size = lua_Integer(lua_rawlen(L, index));
+        for(lua_Integer i = 1; i <= size; ++i){
+            lua_rawgeti(L, index, i);
+            visit_value(L, -1, [&](auto value){
+                visitor(i, value);
+            });
+            lua_pop(L, 1);
+        }
+    }
+}
+
+#endif